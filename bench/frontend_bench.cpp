@@ -0,0 +1,171 @@
+/*
+  Front end throughput: Lexer::tokenize, Parser::parse and
+  CodeGenerator::generate on synthetic programs.
+
+  Run with --benchmark_format=json (or --benchmark_out=file.json) to track
+  results across commits.
+*/
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "codegen.h"
+#include "lexer.h"
+#include "parser.h"
+#include "program_generator.h"
+
+namespace {
+using namespace lge;
+
+using Generator = std::function<std::string(size_t)>;
+
+size_t countNodes(const Expression &expr) {
+  if (const auto *binOp = dynamic_cast<const BinaryOp *>(&expr)) {
+    return 1 + countNodes(*binOp->left) + countNodes(*binOp->right);
+  }
+  if (const auto *unaryOp = dynamic_cast<const UnaryOp *>(&expr)) {
+    return 1 + countNodes(*unaryOp->operand);
+  }
+  if (const auto *call = dynamic_cast<const FunctionCall *>(&expr)) {
+    size_t count = 1;
+    for (const auto &arg : call->args) {
+      count += countNodes(*arg);
+    }
+    return count;
+  }
+  if (const auto *condExpr = dynamic_cast<const ConditionalExpression *>(&expr)) {
+    return 1 + countNodes(*condExpr->condition) + countNodes(*condExpr->thenExpr) +
+           countNodes(*condExpr->elseExpr);
+  }
+  return 1;
+}
+
+size_t countNodes(const Program &program) {
+  size_t count = 1;
+  for (const auto &func : program.functions) {
+    count += 1 + func->parameters.size() + countNodes(*func->body);
+  }
+  return count;
+}
+
+std::unique_ptr<Program> parseSource(const std::string &source) {
+  Lexer lexer(source, "bench.lge");
+  Parser parser(lexer);
+  return parser.parse();
+}
+
+void BM_Lex(benchmark::State &state, const Generator &generate) {
+  const std::string source = generate(state.range(0));
+  size_t tokens = 0;
+
+  for (auto _ : state) {
+    Lexer lexer(source, "bench.lge");
+    auto result = lexer.tokenize();
+    tokens = result.size();
+    benchmark::DoNotOptimize(result.data());
+  }
+
+  state.counters["tokens/s"] =
+      benchmark::Counter(tokens, benchmark::Counter::kIsIterationInvariantRate);
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+void BM_Parse(benchmark::State &state, const Generator &generate) {
+  const std::string source = generate(state.range(0));
+  size_t nodes = 0, functions = 0;
+
+  for (auto _ : state) {
+    // Parser tokenizes on construction, keep that out of the measurement
+    state.PauseTiming();
+    Lexer lexer(source, "bench.lge");
+    Parser parser(lexer);
+    state.ResumeTiming();
+
+    auto program = parser.parse();
+
+    state.PauseTiming();
+    nodes = countNodes(*program);
+    functions = program->functions.size();
+    program.reset();
+    state.ResumeTiming();
+  }
+
+  state.counters["nodes/s"] =
+      benchmark::Counter(nodes, benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["functions/s"] =
+      benchmark::Counter(functions, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+void BM_CodeGen(benchmark::State &state, const Generator &generate) {
+  const auto program = parseSource(generate(state.range(0)));
+  const size_t nodes = countNodes(*program);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto codegen = std::make_unique<CodeGenerator>();
+    state.ResumeTiming();
+
+    codegen->generate(*program);
+
+    state.PauseTiming();
+    codegen.reset();
+    state.ResumeTiming();
+  }
+
+  state.counters["nodes/s"] =
+      benchmark::Counter(nodes, benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["functions/s"] = benchmark::Counter(
+      program->functions.size(), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+const Generator manyFunctions = bench::generateFunctions;
+const Generator deepExpression = bench::generateDeepExpression;
+const Generator longStrings = [](size_t count) {
+  return bench::generateLongStrings(count, 4096);
+};
+
+} // namespace
+
+// Many small functions
+BENCHMARK_CAPTURE(BM_Lex, functions, manyFunctions)
+    ->RangeMultiplier(10)
+    ->Range(10'000, 1'000'000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Parse, functions, manyFunctions)
+    ->RangeMultiplier(10)
+    ->Range(10'000, 1'000'000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_CodeGen, functions, manyFunctions)
+    ->RangeMultiplier(10)
+    ->Range(10'000, 1'000'000)
+    ->Unit(benchmark::kMillisecond);
+
+// Deep expression nesting (the parser recurses per level, so this stays
+// well below what overflows the default 8 MiB stack)
+BENCHMARK_CAPTURE(BM_Lex, deep_expression, deepExpression)
+    ->RangeMultiplier(4)
+    ->Range(64, 4096)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Parse, deep_expression, deepExpression)
+    ->RangeMultiplier(4)
+    ->Range(64, 4096)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_CodeGen, deep_expression, deepExpression)
+    ->RangeMultiplier(4)
+    ->Range(64, 4096)
+    ->Unit(benchmark::kMicrosecond);
+
+// Long string literals (4 KiB each)
+BENCHMARK_CAPTURE(BM_Lex, long_strings, longStrings)
+    ->RangeMultiplier(10)
+    ->Range(100, 10'000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_CodeGen, long_strings, longStrings)
+    ->RangeMultiplier(10)
+    ->Range(100, 10'000)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,57 @@
+#include "program_generator.h"
+
+#include <sstream>
+
+namespace lge::bench {
+
+std::string generateFunctions(size_t count) {
+  std::ostringstream out;
+  out << "let f0: int = (a: int, b: int) -> a + b\n";
+
+  for (size_t i = 1; i < count; i++) {
+    out << "# function " << i << "\n";
+    out << "let f" << i << ": int = (a: int, b: int) ->\n"
+        << "    if a < b\n"
+        << "        then f" << i - 1 << "(a * 2, b - 1)\n"
+        << "        else str_len(\"f" << i << "\") + a / (b + " << i % 7 + 1 << ")\n";
+  }
+
+  out << "let main: int = () -> f" << count - 1 << "(1, 2)\n";
+  return out.str();
+}
+
+std::string generateDeepExpression(size_t depth) {
+  static constexpr const char *ops[] = {" + ", " - ", " * "};
+
+  std::ostringstream out;
+  out << "let main: int = (x: int) -> ";
+  for (size_t i = 0; i < depth; i++) {
+    out << "(" << i % 10 << ops[i % 3];
+  }
+  out << "x";
+  for (size_t i = 0; i < depth; i++) {
+    out << ")";
+  }
+  out << "\n";
+  return out.str();
+}
+
+std::string generateLongStrings(size_t count, size_t length) {
+  std::ostringstream out;
+  for (size_t i = 0; i < count; i++) {
+    out << "let s" << i << ": str = () -> \"";
+    for (size_t j = 0; j < length; j++) {
+      // Sprinkle escapes so the lexer takes its slow path too
+      if (j % 64 == 63) {
+        out << "\\n";
+      } else {
+        out << static_cast<char>('a' + (i + j) % 26);
+      }
+    }
+    out << "\"\n";
+  }
+  out << "let main: int = () -> str_len(s0())\n";
+  return out.str();
+}
+
+} // namespace lge::bench
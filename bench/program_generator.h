@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace lge::bench {
+
+// Synthetic LGE sources for stressing the front end at scale
+
+// `count` functions, each calling the previous one, mixing conditionals,
+// arithmetic, comparisons, string literals and builtin calls
+std::string generateFunctions(size_t count);
+
+// A single function whose body is `depth` nested binary operations
+std::string generateDeepExpression(size_t depth);
+
+// `count` functions each returning a `length` character string literal
+std::string generateLongStrings(size_t count, size_t length);
+
+} // namespace lge::bench
@@ -0,0 +1,186 @@
+#! /usr/bin/python3
+
+import argparse
+from dataclasses import asdict, dataclass
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+from typing import List
+
+MODES = ["lli", "jit", "aot"]
+OPT_LEVELS = [0, 1, 2, 3]
+
+
+@dataclass
+class RunRet:
+    exit_code: int
+    wall_ms: float
+    max_rss_kb: int
+
+
+@dataclass
+class BenchResult:
+    program: str
+    mode: str
+    opt_level: int
+    exit_code: int
+    median_ms: float | None
+    min_ms: float | None
+    instructions: int | None
+    max_rss_kb: int | None
+    error: str | None = None
+
+
+def run_timed(cmd: List[str]) -> RunRet:
+    """Runs cmd with its output discarded, returns wall time and the child's peak RSS."""
+    start = time.perf_counter()
+    proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    _, status, rusage = os.wait4(proc.pid, 0)
+    wall_ms = (time.perf_counter() - start) * 1000
+    proc.returncode = os.waitstatus_to_exitcode(status)
+
+    # ru_maxrss is in kilobytes on Linux
+    return RunRet(proc.returncode, wall_ms, rusage.ru_maxrss)
+
+
+def count_instructions(cmd: List[str]) -> int | None:
+    """Counts retired user space instructions with perf stat, None if perf is unavailable."""
+    if shutil.which("perf") is None:
+        return None
+
+    perf_cmd = ["perf", "stat", "-x", ",", "-e", "instructions:u", "--"] + cmd
+    result = subprocess.run(perf_cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    for line in result.stderr.splitlines():
+        fields = line.split(",")
+        if len(fields) > 2 and fields[2].startswith("instructions") and fields[0].isdigit():
+            return int(fields[0])
+    return None
+
+
+def compile_program(args: argparse.Namespace, source: str, mode: str, opt_level: int,
+                    work_dir: str) -> List[str]:
+    """Builds source for the given mode and returns the command that runs it."""
+    name = os.path.splitext(os.path.basename(source))[0]
+    base = os.path.join(work_dir, f"{name}_O{opt_level}")
+    opt = f"-O{opt_level}"
+
+    if mode == "jit":
+        # Compilation happens inside the measured process, as for lli
+        return [args.compiler, opt, "--run", "--load", args.run_time, source]
+
+    if mode == "lli":
+        subprocess.run([args.compiler, opt, "--emit=bc", "-o", f"{base}.bc", source],
+                       check=True, capture_output=True)
+        return [args.lli, f"-load={args.run_time}", f"{base}.bc"]
+
+    subprocess.run([args.compiler, opt, "--emit=obj", "-o", f"{base}.o", source],
+                   check=True, capture_output=True)
+    run_time_dir = os.path.dirname(os.path.abspath(args.run_time))
+    subprocess.run([args.cc, f"{base}.o", os.path.abspath(args.run_time), f"-Wl,-rpath,{run_time_dir}",
+                    "-o", base], check=True, capture_output=True)
+    return [base]
+
+
+def bench_program(args: argparse.Namespace, source: str, mode: str, opt_level: int,
+                  work_dir: str) -> BenchResult:
+    name = os.path.splitext(os.path.basename(source))[0]
+    try:
+        cmd = compile_program(args, source, mode, opt_level, work_dir)
+    except subprocess.CalledProcessError as e:
+        stderr = e.stderr.decode(errors="replace") if e.stderr else ""
+        return BenchResult(name, mode, opt_level, e.returncode, None, None, None, None,
+                           f"build failed: {stderr.strip()}")
+
+    for _ in range(args.warmup):
+        run_timed(cmd)
+
+    runs = [run_timed(cmd) for _ in range(args.repetitions)]
+    times = [run.wall_ms for run in runs]
+    instructions = count_instructions(cmd) if args.instructions else None
+
+    return BenchResult(
+        program=name,
+        mode=mode,
+        opt_level=opt_level,
+        exit_code=runs[-1].exit_code,
+        median_ms=round(statistics.median(times), 3),
+        min_ms=round(min(times), 3),
+        instructions=instructions,
+        max_rss_kb=max(run.max_rss_kb for run in runs),
+    )
+
+
+def main(args: argparse.Namespace):
+    assert os.path.exists(args.compiler)
+    assert os.path.exists(args.run_time)
+
+    programs = sorted(
+        os.path.join(args.programs, f) for f in os.listdir(args.programs) if f.endswith(".lge"))
+    if args.filter:
+        programs = [p for p in programs if any(f in os.path.basename(p) for f in args.filter)]
+
+    results: List[BenchResult] = []
+    with tempfile.TemporaryDirectory(prefix="lge_bench_") as work_dir:
+        for source in programs:
+            for mode in args.modes:
+                for opt_level in args.opt_levels:
+                    result = bench_program(args, source, mode, opt_level, work_dir)
+                    results.append(result)
+
+                    status = f"{result.median_ms} ms" if result.error is None else "FAILED"
+                    print(f"{result.program:<16} {mode:<4} -O{opt_level}  {status}",
+                          file=sys.stderr)
+
+    report = {
+        "version": 1,
+        "repetitions": args.repetitions,
+        "results": [asdict(r) for r in results],
+    }
+
+    if args.output:
+        with open(args.output, "w", encoding="utf-8") as f:
+            json.dump(report, f, indent=2)
+    else:
+        json.dump(report, sys.stdout, indent=2)
+        print()
+
+    if any(r.error is not None for r in results):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        epilog="example: run_bench.py -c ../build/lgec -r ../build/runtime/liblge_runtime.so -o bench.json")
+
+    parser.add_argument("-c", "--compiler",
+                        help="Path to the built compiler", required=True)
+    parser.add_argument("-r", "--run-time",
+                        help="Path to the liblge_runtime.so", required=True)
+    parser.add_argument("-p", "--programs",
+                        default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "programs"),
+                        help="Folder containing the benchmark programs")
+    parser.add_argument("-o", "--output",
+                        help="Write the JSON report to this file instead of stdout")
+    parser.add_argument("-n", "--repetitions", type=int, default=5,
+                        help="Measured runs per configuration")
+    parser.add_argument("--warmup", type=int, default=1,
+                        help="Unmeasured runs per configuration")
+    parser.add_argument("--modes", nargs="+", choices=MODES, default=MODES,
+                        help="Execution modes to benchmark")
+    parser.add_argument("--opt-levels", nargs="+", type=int, choices=OPT_LEVELS, default=OPT_LEVELS,
+                        help="Optimization levels to benchmark")
+    parser.add_argument("--filter", nargs="+",
+                        help="Only run programs whose file name contains one of these strings")
+    parser.add_argument("--no-instructions", dest="instructions", action="store_false",
+                        help="Skip counting instructions with perf stat")
+    parser.add_argument("--lli", default="lli", help="lli executable")
+    parser.add_argument("--cc", default="cc", help="C compiler used to link AOT binaries")
+
+    args = parser.parse_args()
+
+    main(args)
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -16,13 +17,24 @@ enum class TokenType : int32_t {
   STRING_LITERAL,
   INT_LITERAL,
   FLOAT_LITERAL,
+  CHAR_LITERAL,
 
   // Keywords
   LET,
+  IN,
   // Conditional keywords
   IF,
   THEN,
   ELSE,
+  // Pattern matching keywords
+  MATCH,
+  WITH,
+  // Boolean keywords
+  TRUE,
+  FALSE,
+  AND,
+  OR,
+  NOT,
 
   // Operators
   ARROW,    // ->
@@ -31,6 +43,14 @@ enum class TokenType : int32_t {
   MULTIPLY, // *
   DIVIDE,   // /
   EQUALS,   // =
+  PIPE,     // | (match arms and bitwise or)
+
+  // Integer operators
+  PERCENT,     // %
+  AMPERSAND,   // &
+  CARET,       // ^
+  SHIFT_LEFT,  // <<
+  SHIFT_RIGHT, // >>
 
   // Comparison operators
   LESS_THAN,     // <
@@ -41,10 +61,15 @@ enum class TokenType : int32_t {
   NOT_EQUAL,     // !=
 
   // Delimiters
-  LPAREN, // (
-  RPAREN, // )
+  LPAREN,   // (
+  RPAREN,   // )
+  LBRACKET, // [
+  RBRACKET, // ]
+  LBRACE,   // {
+  RBRACE,   // }
   COLON,  // :
   COMMA,  // ,
+  DOT,    // .
 
   // Types
   TYPE_INT,   // int
@@ -52,6 +77,15 @@ enum class TokenType : int32_t {
   TYPE_CHAR,  // char
   TYPE_STR,   // str
   TYPE_FUNC,  // func
+  TYPE_I8,    // i8
+  TYPE_I16,   // i16
+  TYPE_I64,   // i64
+  TYPE_F64,   // f64
+  TYPE_VEC4F, // vec4f
+  TYPE_VEC8F, // vec8f
+  TYPE_VEC4I, // vec4i
+  TYPE_VEC8I, // vec8i
+  TYPE_BOOL,  // bool
 
   // Special
   NEWLINE,
@@ -87,7 +121,8 @@ class Type;
 
 using ASTNodePtr = std::unique_ptr<ASTNode>;
 using ExprPtr = std::unique_ptr<Expression>;
-using FuncDefPtr = std::unique_ptr<FunctionDef>;
+// Shared, a merged program references the functions of cached per-file programs
+using FuncDefPtr = std::shared_ptr<FunctionDef>;
 using TypePtr = std::unique_ptr<Type>;
 
 // Base AST node
@@ -102,11 +137,34 @@ public:
 
 class Type : public ASTNode {
 public:
-  enum TypeKind { INT, FLOAT, CHAR, STR, FUNC };
+  // INT and FLOAT are 32 bits wide, i32 and f32 are other names for them.
+  // VEC* are SIMD vectors of 4 or 8 float or int lanes. BOOL is one bit.
+  enum TypeKind {
+    INT,
+    FLOAT,
+    CHAR,
+    STR,
+    FUNC,
+    ARRAY,
+    I8,
+    I16,
+    I64,
+    F64,
+    VEC4F,
+    VEC8F,
+    VEC4I,
+    VEC8I,
+    TUPLE,
+    RECORD,
+    BOOL
+  };
 
   TypeKind kind;
-  std::vector<TypePtr> paramTypes; // For func types
-  TypePtr returnType;              // For func types
+  std::vector<TypePtr> paramTypes;     // For func types
+  TypePtr returnType;                  // For func types
+  TypePtr elementType;                 // For array types
+  std::vector<TypePtr> fieldTypes;     // For tuple and record types
+  std::vector<std::string> fieldNames; // For record types
 
   Type(TypeKind k, const Location &loc) : ASTNode(loc), kind(k) {}
 
@@ -130,20 +188,34 @@ public:
   void dump(int indent = 0) const override;
 };
 
+// int unless the value needs i64, takes the type of the other operand,
+// parameter or return value when it fits. Character literals are parsed
+// into their byte value.
 class IntLiteral : public Expression {
 public:
-  int value;
+  int64_t value;
 
-  IntLiteral(int val, const Location &loc) : Expression(loc), value(val) {}
+  IntLiteral(int64_t val, const Location &loc) : Expression(loc), value(val) {}
 
   void dump(int indent = 0) const override;
 };
 
+// float unless used as an f64
 class FloatLiteral : public Expression {
 public:
-  float value;
+  double value;
 
-  FloatLiteral(float val, const Location &loc) : Expression(loc), value(val) {}
+  FloatLiteral(double val, const Location &loc) : Expression(loc), value(val) {}
+
+  void dump(int indent = 0) const override;
+};
+
+// true or false
+class BoolLiteral : public Expression {
+public:
+  bool value;
+
+  BoolLiteral(bool val, const Location &loc) : Expression(loc), value(val) {}
 
   void dump(int indent = 0) const override;
 };
@@ -169,7 +241,15 @@ public:
     LESS_EQUAL,
     GREATER_EQUAL,
     EQUAL_EQUAL,
-    NOT_EQUAL
+    NOT_EQUAL,
+    AND, // Short-circuit, the right operand only runs if needed
+    OR,
+    MOD, // Remainder, the sign of the left operand
+    BIT_AND,
+    BIT_OR,
+    BIT_XOR,
+    SHL, // Shift amounts are taken modulo the bit width
+    SHR  // Arithmetic, keeps the sign
   };
 
   OpType op;
@@ -184,7 +264,7 @@ public:
 
 class UnaryOp : public Expression {
 public:
-  enum OpType { NEG };
+  enum OpType { NEG, NOT };
   OpType op;
   ExprPtr operand;
 
@@ -218,6 +298,95 @@ public:
   void dump(int indent = 0) const override;
 };
 
+// [a, b, ...], the elements share one type
+class ArrayLiteral : public Expression {
+public:
+  std::vector<ExprPtr> elements;
+
+  ArrayLiteral(std::vector<ExprPtr> elems, const Location &loc)
+      : Expression(loc), elements(std::move(elems)) {}
+
+  void dump(int indent = 0) const override;
+};
+
+// array[index], 0 when the index is out of range
+class IndexExpression : public Expression {
+public:
+  ExprPtr array;
+  ExprPtr index;
+
+  IndexExpression(ExprPtr arr, ExprPtr idx, const Location &loc)
+      : Expression(loc), array(std::move(arr)), index(std::move(idx)) {}
+
+  void dump(int indent = 0) const override;
+};
+
+// (a, b, ...) or {name: a, ...}, a tuple or record value with the fields in
+// order. Tuples have no field names.
+class RecordLiteral : public Expression {
+public:
+  std::vector<std::string> fieldNames;
+  std::vector<ExprPtr> fields;
+
+  RecordLiteral(std::vector<std::string> names, std::vector<ExprPtr> values, const Location &loc)
+      : Expression(loc), fieldNames(std::move(names)), fields(std::move(values)) {}
+
+  void dump(int indent = 0) const override;
+};
+
+// record.name or tuple.0
+class FieldAccess : public Expression {
+public:
+  ExprPtr record;
+  std::string field;
+
+  FieldAccess(ExprPtr rec, const std::string &f, const Location &loc)
+      : Expression(loc), record(std::move(rec)), field(f) {}
+
+  void dump(int indent = 0) const override;
+};
+
+// let name = value in body, or let (a, b, ...) = value in body binding the
+// fields of a tuple or record in order
+class LetExpression : public Expression {
+public:
+  std::vector<std::string> names;
+  bool destructure;
+  ExprPtr value;
+  ExprPtr body;
+
+  LetExpression(std::vector<std::string> n, bool destr, ExprPtr val, ExprPtr b,
+                const Location &loc)
+      : Expression(loc), names(std::move(n)), destructure(destr), value(std::move(val)),
+        body(std::move(b)) {}
+
+  void dump(int indent = 0) const override;
+};
+
+// One arm of a match, its patterns are int or string literals. The `_`
+// arm has no patterns.
+struct MatchArm {
+  std::vector<ExprPtr> patterns;
+  ExprPtr body;
+  Location location;
+
+  MatchArm(std::vector<ExprPtr> p, ExprPtr b, const Location &loc)
+      : patterns(std::move(p)), body(std::move(b)), location(loc) {}
+};
+
+// match subject with | p -> e | p | p -> e | _ -> e, on an integer, char or
+// str. The last arm is always `_`.
+class MatchExpression : public Expression {
+public:
+  ExprPtr subject;
+  std::vector<MatchArm> arms;
+
+  MatchExpression(ExprPtr subj, std::vector<MatchArm> a, const Location &loc)
+      : Expression(loc), subject(std::move(subj)), arms(std::move(a)) {}
+
+  void dump(int indent = 0) const override;
+};
+
 // Param for func definition
 struct Parameter {
   std::string name;
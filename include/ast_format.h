@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "ast.h"
+
+namespace lge {
+
+// Binary AST files (.lgeast), a parsed program that can be compiled without
+// the source. Layout, integers are ULEB128 unless noted:
+//   magic "LGEAST\0\0", version (u32 little endian)
+//   string table: count, then length + bytes for each string
+//   file table: count, then the string index of each file name
+//   functions: count, then each function's nodes in prefix order
+// Locations are (file index, line, column), every name is a string index.
+// Files are read in place from a (usually memory mapped) buffer.
+constexpr uint32_t astFormatVersion = 6;
+
+// True for paths with the .lgeast extension
+bool isASTFile(const std::string &filename);
+
+// Writes the program to outputFile ("-" or empty => stdout)
+void writeAST(const Program &program, const std::string &outputFile);
+
+// Throws std::runtime_error if the file is not a valid AST of this version
+std::shared_ptr<Program> readAST(const std::string &filename);
+
+} // namespace lge
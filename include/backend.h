@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+namespace lge {
+
+enum class EmitKind { LLVM, BITCODE, ASSEMBLY, OBJECT };
+
+// Writes the module to outputFile ("-" or empty => stdout). Assembly and
+// object files are generated for the host.
+void emitModule(llvm::Module &module, EmitKind kind, const std::string &outputFile);
+
+// ORC JIT resolving builtins and libc from the process and the given
+// shared libraries. fastCodeGen skips machine code optimization, for many
+// small modules (REPL inputs) where compile time dominates.
+std::unique_ptr<llvm::orc::LLJIT> createJIT(const std::vector<std::string> &libraries,
+                                            bool fastCodeGen = false);
+
+// JIT compiles the module and runs its main(), returning its exit code.
+int runModule(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context,
+              const std::vector<std::string> &libraries);
+
+} // namespace lge
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/Constants.h>
@@ -16,42 +19,169 @@
 #include <llvm/Support/raw_ostream.h>
 
 #include "ast.h"
+#include "codegen_options.h"
+#include "cost_model.h"
+#include "purity.h"
 
 namespace lge {
 
 class CodeGenerator {
 public:
-  CodeGenerator();
+  explicit CodeGenerator(const CodeGenOptions &options = {});
   ~CodeGenerator() = default;
 
   void generate(const Program &program);
+  // Declares every function of the program but only emits the bodies of
+  // `bodies`, the others stay external declarations (sharded compilation).
+  // The analyses are of the whole program, computed once for all shards.
+  void generate(const Program &program, const std::vector<const FunctionDef *> &bodies,
+                const PurityAnalysis &purity, const CostModel &costModel);
+  // Emits `void name()` that evaluates expr and prints its value, functions
+  // of the program are declared as they are referenced (REPL)
+  void generateEvaluation(const Program &program, const std::string &name, const Expression &expr);
+  bool verify();
+  bool hasErrors() const { return errorCount > 0; }
 
   void emitIR();
   std::string getIR();
 
+  llvm::Module &getModule() { return *module; }
+
+  // Hand the module over (e.g. to the JIT), take the module first as it
+  // must not outlive its context
+  std::unique_ptr<llvm::Module> takeModule() { return std::move(module); }
+  std::unique_ptr<llvm::LLVMContext> takeContext() { return std::move(context); }
+
 private:
   // LLVM infra
-  llvm::LLVMContext context;
+  std::unique_ptr<llvm::LLVMContext> context;
   std::unique_ptr<llvm::Module> module;
   std::unique_ptr<llvm::IRBuilder<>> builder;
 
   // Symbol tables
   std::unordered_map<std::string, llvm::Value *> namedValues;
   std::unordered_map<std::string, llvm::Function *> functions;
+  std::unordered_map<std::string, const FunctionDef *> definitions;
+  CodeGenOptions options;
+  // Of the program being generated, owned by the caller of generate
+  const PurityAnalysis *purity = nullptr;
+  const CostModel *costModel = nullptr; // Only consulted with options.autoParallel
+
+  // Interned string literals, one private global per distinct value
+  std::unordered_map<std::string, llvm::Constant *> stringPool;
+  std::unordered_map<const llvm::Value *, size_t> literalLengths;
+
+  // Array struct type => element type
+  std::unordered_map<const llvm::Type *, llvm::Type *> arrayElements;
+  // Tuple or record struct type => field names (empty for tuples)
+  std::unordered_map<const llvm::Type *, std::vector<std::string>> recordFields;
 
   // Current function being compiled
   llvm::Function *currentFunction = nullptr;
 
+  size_t errorCount = 0;
+
   // Helper
   llvm::Type *llvmType(const Type &type);
   llvm::Value *generateExpression(const Expression &expr);
+  bool registerFunction(const FunctionDef &func, bool reportDuplicate);
+  llvm::Function *lookupFunction(const std::string &name);
+  llvm::Function *declareFunction(const FunctionDef &func);
   llvm::Function *generateFunction(const FunctionDef &func);
 
+  // Implicit conversions: integers and floats widen to the larger type of
+  // their family, bools widen to integers as 0 or 1, literals take the type
+  // they are used at if they fit. Returns value unchanged if it can't be
+  // converted.
+  llvm::Value *convertTo(llvm::Value *value, const Expression &expr, llvm::Type *type);
+  // Brings both operands to one type, false if they have none in common
+  bool unifyOperands(llvm::Value *&left, const Expression &leftExpr, llvm::Value *&right,
+                     const Expression &rightExpr);
+  // to_i8 ... to_f64, explicit and possibly narrowing
+  llvm::Value *generateConversion(const FunctionCall &call);
+  // Value of a condition as an i1, numbers are true unless 0
+  llvm::Value *generateCondition(const Expression &expr, const std::string &context);
+  // and/or branch around the right operand, which only runs if the left
+  // one doesn't decide the result
+  llvm::Value *generateShortCircuit(const BinaryOp &binOp);
+  // splat, pack, extract, insert, select, any, all and reduce_* over SIMD
+  // vectors, comparisons of vectors give vectors of i1 (masks)
+  llvm::Value *generateVectorBuiltin(const FunctionCall &call);
+  std::string typeName(const llvm::Type *type) const;
+  // char and i8 are both i8 in LLVM, the expression's declared type tells
+  // them apart where it is known
+  std::string typeName(const llvm::Type *type, const Expression &expr) const;
+  // Source level type of an expression as far as declarations give it
+  // (function return types, str_at), nullptr if unknown
+  const Type *declaredType(const Expression &expr) const;
+
+  // String literal pool
+  llvm::Constant *internString(const std::string &value);
+  std::optional<size_t> literalLength(const llvm::Value *value) const;
+
+  // Inline lowering of builtins (nullptr => emit the runtime call)
+  llvm::Value *lowerBuiltinCall(const FunctionCall &call, const std::vector<llvm::Value *> &args);
+  llvm::Value *generateStrAt(llvm::Value *str, llvm::Value *index,
+                             std::optional<size_t> literalLength);
+
+  // Arrays are {element*, i32 length} structs over storage from lge_alloc
+  llvm::StructType *arrayType(llvm::Type *elementType);
+  llvm::Type *arrayElementType(const llvm::Type *type) const; // nullptr if not an array
+  llvm::Value *allocateArray(llvm::Type *elementType, llvm::Value *length);
+  llvm::Value *generateArrayLiteral(const ArrayLiteral &literal);
+  llvm::Value *generateIndex(const IndexExpression &indexExpr);
+  llvm::Value *generateArrayBuiltin(const FunctionCall &call);
+  // map, fold, zip_with and their parallel versions par_map, par_reduce
+  llvm::Value *generateArrayIteration(const FunctionCall &call);
+
+  // Tuples and records are first class structs, passed and returned by
+  // value so that SROA keeps their fields in registers
+  llvm::StructType *recordType(const std::vector<llvm::Type *> &fieldTypes,
+                               const std::vector<std::string> &fieldNames);
+  // nullptr if not a tuple or record
+  const std::vector<std::string> *recordFieldNames(const llvm::Type *type) const;
+  llvm::Value *generateRecordLiteral(const RecordLiteral &literal);
+  llvm::Value *generateFieldAccess(const FieldAccess &access);
+  llvm::Value *generateLet(const LetExpression &let);
+
+  // Integers and chars dispatch with a switch (a jump table or binary
+  // search), strings switch on their length and then compare the patterns
+  // of that length
+  llvm::Value *generateMatch(const MatchExpression &match);
+  bool dispatchString(llvm::Value *subject, const MatchExpression &match,
+                      const std::vector<llvm::BasicBlock *> &armBlocks);
+  // Outlines body(captured, i) into a function the runtime's worker threads
+  // call for chunks of [0, count). Captures are loaded from an environment
+  // struct, body must not use any other value of the calling function.
+  void generateParallelFor(
+      llvm::Value *count, const std::vector<llvm::Value *> &captures,
+      const std::function<void(const std::vector<llvm::Value *> &, llvm::Value *)> &body);
+  // for (i = 0; i < count; i++) acc = body(i, acc) with an i32 count, returns
+  // the final acc. Without an initial value acc is nullptr and body returns
+  // nullptr.
+  llvm::Value *
+  generateLoop(llvm::Value *count, llvm::Value *initial,
+               const std::function<llvm::Value *(llvm::Value *, llvm::Value *)> &body);
+
+  // Fork-join tasks (--auto-par). The call's arguments are evaluated right
+  // away, the call itself may run on another thread until joined.
+  struct SpawnedTask {
+    llvm::StructType *envType; // Arguments, then the result
+    llvm::Value *env;
+    llvm::Value *handle;
+  };
+  const FunctionCall *spawnableOperand(const BinaryOp &binOp); // nullptr => evaluate in order
+  std::optional<SpawnedTask> spawnCall(const FunctionCall &call);
+  llvm::Value *joinTask(const SpawnedTask &task);
+
   // Built-in func declarations
   void declareBuiltinFunctions();
   llvm::Function *declareBuiltinFunction(const std::string &name, llvm::Type *returnType,
                                          const std::vector<llvm::Type *> &paramTypes);
 
+  // Target CPU attributes on every function defined in the module (--cpu)
+  void applyTargetCPU();
+
   void reportError(const std::string &message, const Location &loc);
 };
 
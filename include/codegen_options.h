@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+namespace lge {
+
+// Options that change the generated code, part of the function cache key
+struct CodeGenOptions {
+  // Evaluate expensive independent pure calls as parallel tasks (--auto-par)
+  bool autoParallel = false;
+  // Functions are compiled for this CPU and these features (--cpu), empty
+  // for the generic target
+  std::string cpu;
+  std::string cpuFeatures;
+};
+
+} // namespace lge
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ast.h"
+
+namespace lge {
+
+// Static estimate of how expensive evaluating an expression is, roughly in
+// instructions. A call costs its callee's body, builtins looping over an
+// array or a string a fixed guess. Recursion can't be bounded, calls that
+// may recurse cost `unbounded`.
+//
+// Every function's cost is computed when the model is built, after that it
+// is only read and can be shared between threads.
+class CostModel {
+public:
+  static constexpr uint64_t unbounded = std::numeric_limits<uint64_t>::max();
+
+  CostModel() = default;
+  explicit CostModel(const Program &program);
+
+  uint64_t cost(const Expression &expr) const;
+  // Cost of the body of a function the program defines
+  uint64_t functionCost(const std::string &name) const;
+
+private:
+  std::unordered_map<std::string, const FunctionDef *> definitions;
+  // Filled in by the constructor, only read afterwards
+  mutable std::unordered_map<std::string, uint64_t> functionCosts;
+  mutable std::unordered_set<std::string> visiting; // Functions whose cost is being computed
+};
+
+} // namespace lge
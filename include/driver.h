@@ -0,0 +1,11 @@
+#pragma once
+
+#include "frontend.h"
+
+namespace lge {
+
+// Parses the command line and runs one compilation, returns the process
+// exit code. With an AST cache, unchanged input files aren't parsed again.
+int runCompiler(int argc, const char *const *argv, ASTCache *astCache = nullptr);
+
+} // namespace lge
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/Support/Chrono.h>
+
+#include "ast.h"
+#include "lexer.h"
+#include "parser.h"
+#include "timing.h"
+
+namespace lge {
+
+// One input file after lexing and parsing
+struct SourceUnit {
+  std::string filename;
+  std::optional<Lexer> lexer;
+  std::optional<Parser> parser; // Refers to lexer, units must not be moved individually
+  std::shared_ptr<Program> program;
+  std::exception_ptr error; // Set if the front end threw for this file
+  ThreadTime lexTime;        // Measured on the thread that parsed the file
+  ThreadTime parseTime;
+};
+
+// Lexes and parses every file on up to `jobs` threads, results are in input order
+std::vector<SourceUnit> parseSources(const std::vector<std::string> &filenames, unsigned jobs);
+
+// Program made of the functions of all programs, in input order. The
+// functions are shared, not copied. Name resolution across files is done
+// by the code generator.
+std::unique_ptr<Program> mergePrograms(const std::vector<std::shared_ptr<Program>> &programs);
+
+// Parsed programs by path, reused as long as the file's size and
+// modification time don't change (compile server)
+class ASTCache {
+public:
+  std::shared_ptr<Program> lookup(const std::string &filename) const;
+  void insert(const std::string &filename, std::shared_ptr<Program> program);
+
+private:
+  struct Entry {
+    llvm::sys::TimePoint<> modified;
+    uint64_t size;
+    std::shared_ptr<Program> program;
+  };
+
+  std::unordered_map<std::string, Entry> entries;
+};
+
+} // namespace lge
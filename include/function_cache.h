@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "ast.h"
+#include "codegen_options.h"
+#include "cost_model.h"
+#include "purity.h"
+
+namespace lge {
+
+// Persistent cache of optimized bitcode, one entry per function. Entries are
+// keyed by the function's AST (without locations), the signatures and purity
+// of the functions it references (and their costs with --auto-par), the code
+// generation options and the compiler binary.
+// The directory is kept under maxBytes by evicting the least recently used.
+class FunctionCache {
+public:
+  FunctionCache(const std::string &directory, uint64_t maxBytes);
+
+  std::string key(const FunctionDef &func,
+                  const std::unordered_map<std::string, const FunctionDef *> &definitions,
+                  const PurityAnalysis &purity, const CostModel &costModel,
+                  unsigned optLevel, const CodeGenOptions &options) const;
+
+  // nullptr on a miss, a hit counts as a use for the LRU order
+  std::unique_ptr<llvm::MemoryBuffer> lookup(const std::string &key);
+
+  // Best effort, failing to write an entry only costs a recompile next time
+  void store(const std::string &key, llvm::ArrayRef<char> bitcode);
+
+  // Evicts least recently used entries until the size limit is met
+  void prune();
+
+  size_t hits() const { return hitCount; }
+  size_t misses() const { return missCount; }
+
+private:
+  std::string directory;
+  uint64_t maxBytes;
+  std::string compilerId;
+
+  std::atomic<size_t> hitCount{0};
+  std::atomic<size_t> missCount{0};
+
+  std::string entryPath(const std::string &key) const;
+};
+
+} // namespace lge
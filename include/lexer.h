@@ -37,6 +37,7 @@ private:
   Token handleIdentifier();
   Token handleNumber();
   Token handleString();
+  Token handleChar();
   Token handleComment();
 
   Token makeToken(const TokenType type, const std::string &value = "");
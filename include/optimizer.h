@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+namespace lge {
+
+// TargetMachine for the host, used for cost models and native code emission
+std::unique_ptr<llvm::TargetMachine> createHostTargetMachine();
+
+// Links the embedded runtime bitcode into the module, only pulling in the
+// builtins it references. They get internal linkage so they can be inlined.
+void linkRuntime(llvm::Module &module);
+
+// Runs LLVM's default pipeline for the given level (0 => no-op)
+void optimizeModule(llvm::Module &module, unsigned optLevel);
+
+} // namespace lge
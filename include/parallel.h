@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lge {
+
+// Calls fn(i) for every i in [0, count) on up to `jobs` threads, the calling
+// thread included. Indices are handed out one at a time so a few expensive
+// items don't serialize the rest. The first exception thrown by fn stops the
+// remaining items and is rethrown on the calling thread.
+template <typename Fn> void parallelFor(size_t count, size_t jobs, Fn fn) {
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  auto worker = [&] {
+    try {
+      for (size_t i = next++; i < count; i = next++) {
+        fn(i);
+      }
+    } catch (...) {
+      std::lock_guard lock(errorMutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+      next = count;
+    }
+  };
+
+  const size_t threadCount = std::clamp<size_t>(jobs, 1, std::max<size_t>(count, 1));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < threadCount; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace lge
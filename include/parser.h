@@ -13,6 +13,8 @@ public:
   Parser(Lexer &lexer);
 
   std::unique_ptr<Program> parse();
+  // One expression making up the whole input (REPL), throws on errors
+  std::unique_ptr<Expression> parseSingleExpression();
 
   void dumpAST(const Program &program);
   bool hasErrors() const { return !errors.empty(); }
@@ -23,6 +25,7 @@ private:
   std::vector<Token> tokens;
   size_t current = 0;
   std::vector<std::string> errors;
+  bool pipeEndsArm = false; // In a match arm body, where `|` starts the next arm
 
   Token peek() const;
   Token previous() const;
@@ -40,13 +43,30 @@ private:
   std::unique_ptr<Type> parseType();
   std::vector<Parameter> parseParameters();
   std::unique_ptr<Expression> parseExpression();
+  // An expression followed by a closing delimiter, `|` is bitwise or in it
+  // even within a match arm
+  std::unique_ptr<Expression> parseEnclosed();
   std::unique_ptr<Expression> parseAddition();
   std::unique_ptr<Expression> parseMultiplication();
   std::unique_ptr<Expression> parseUnary();
+  std::unique_ptr<Expression> parsePostfix();
   std::unique_ptr<Expression> parsePrimary();
   std::unique_ptr<Expression> parseCall(std::unique_ptr<Expression> expr);
   std::unique_ptr<Expression> parseConditional();
+  std::unique_ptr<Expression> parseLet();
+  std::unique_ptr<Expression> parseMatch();
+  std::unique_ptr<Expression> parsePattern();
+  std::unique_ptr<Expression> parseOr();
+  std::unique_ptr<Expression> parseAnd();
+  std::unique_ptr<Expression> parseNot();
   std::unique_ptr<Expression> parseComparison();
+  std::unique_ptr<Expression> parseBitOr();
+  std::unique_ptr<Expression> parseBitXor();
+  std::unique_ptr<Expression> parseBitAnd();
+  std::unique_ptr<Expression> parseShift();
+  // A BinaryOp, or the literal it evaluates to for integer literals
+  std::unique_ptr<Expression> makeBinary(BinaryOp::OpType op, std::unique_ptr<Expression> left,
+                                         std::unique_ptr<Expression> right, const Location &loc);
 };
 
 } // namespace lge
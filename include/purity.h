@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.h"
+
+namespace lge {
+
+// Which functions of a program are free of side effects. A function is
+// impure if it does I/O (str_print, str_read), calls through a function
+// value (the target is unknown) or references an impure function, directly
+// or through its callees. Recursion alone doesn't make
+// a function impure.
+class PurityAnalysis {
+public:
+  PurityAnalysis() = default;
+  explicit PurityAnalysis(const Program &program);
+
+  // False for functions the program doesn't define
+  bool isPure(const std::string &name) const;
+
+private:
+  std::unordered_set<std::string> pure;
+};
+
+} // namespace lge
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "codegen_options.h"
+
+namespace lge {
+
+// Interactive session on one JIT that lives as long as the session. Each
+// input is compiled into a module of its own: `let` definitions are kept and
+// callable from later inputs, any other input is evaluated as an expression
+// and its value printed. A line ending in '\' continues on the next one.
+// The prelude's functions are defined before the first input.
+int runRepl(const Program &prelude, const std::vector<std::string> &libraries, unsigned optLevel,
+            const CodeGenOptions &options = {});
+
+} // namespace lge
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace lge {
+
+// Compile server: accepts requests on a Unix socket and runs them one at a
+// time in this process, so LLVM initialization and parsed files are reused.
+// Requests running user code (--run, --repl) are handled by a forked child.
+// A request carries the client's arguments, working directory and
+// stdin/stdout/stderr, the reply is the exit code.
+int serve(const std::string &socketPath);
+
+// Client side: runs the compilation on the server, returns its exit code
+int connectAndRun(const std::string &socketPath, const std::vector<std::string> &args);
+
+} // namespace lge
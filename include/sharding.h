@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "ast.h"
+#include "function_cache.h"
+
+namespace lge {
+
+// Splits code generation and optimization of a program over N threads.
+// Each shard has its own LLVMContext and module, functions defined in
+// other shards are declared external.
+//
+// With a cache every function is a shard of its own, processed by the N
+// threads, so unchanged functions are loaded instead of compiled.
+class ShardedCompiler {
+public:
+  ShardedCompiler(const Program &program, unsigned shardCount, FunctionCache *cache = nullptr);
+
+  // Generates, verifies and optimizes every shard, false if any of them
+  // reported errors
+  bool compile(unsigned optLevel, const CodeGenOptions &options = {});
+
+  // Links all shards into one module of the given context (bitcode round trip)
+  std::unique_ptr<llvm::Module> link(llvm::LLVMContext &context);
+
+  // Emits each shard as a native object named <base>.<N>.o, returns their
+  // paths. Not available with a cache, cached shards are bitcode only.
+  std::vector<std::string> emitObjects(const std::string &base);
+
+private:
+  struct Shard {
+    std::vector<const FunctionDef *> functions;
+    std::unique_ptr<llvm::LLVMContext> context;
+    std::unique_ptr<llvm::Module> module;
+    std::unique_ptr<llvm::MemoryBuffer> bitcode; // Set once serialized or loaded from the cache
+    bool hadErrors = false;
+  };
+
+  const Program &program;
+  FunctionCache *cache;
+  unsigned threadCount;
+  std::vector<Shard> shards;
+
+  void serialize(Shard &shard);
+};
+
+} // namespace lge
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <llvm/Support/TimeProfiler.h>
+
+namespace lge {
+
+// Wall and CPU time of the calling thread, for phases split over worker
+// threads: each thread measures its own part and the parts are summed
+struct ThreadTime {
+  double wallMs = 0;
+  double cpuMs = 0;
+
+  static ThreadTime now();
+
+  ThreadTime operator-(const ThreadTime &other) const {
+    return {wallMs - other.wallMs, cpuMs - other.cpuMs};
+  }
+  ThreadTime &operator+=(const ThreadTime &other) {
+    wallMs += other.wallMs;
+    cpuMs += other.cpuMs;
+    return *this;
+  }
+};
+
+// Wall/CPU time and peak RSS of each compiler phase (--time-report)
+class PhaseTimer {
+public:
+  // The peak RSS is the process' high water mark, which in a long running
+  // process (--serve) covers every request so far, so it can be left out
+  explicit PhaseTimer(bool reportPeakRss = true) : reportPeakRss(reportPeakRss) {}
+
+  // Measures a phase for its lifetime, also emitted as a trace event when
+  // LLVM's time trace profiler is enabled
+  class Scope {
+  public:
+    Scope(PhaseTimer &timer, const std::string &name);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    PhaseTimer &timer;
+    std::string name;
+    std::chrono::steady_clock::time_point wallStart;
+    double cpuStart;
+    llvm::TimeTraceScope traceScope;
+  };
+
+  Scope phase(const std::string &name) { return Scope(*this, name); }
+
+  // Adds a phase measured elsewhere, e.g. summed over threads
+  void record(const std::string &name, const ThreadTime &time);
+
+  void report(std::ostream &os) const;
+
+private:
+  struct Phase {
+    std::string name;
+    double wallMs;
+    double cpuMs;
+    long peakRssKb;
+  };
+
+  bool reportPeakRss;
+  std::vector<Phase> phases;
+};
+
+} // namespace lge
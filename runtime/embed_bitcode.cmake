@@ -0,0 +1,11 @@
+# Turns INPUT (runtime bitcode) into a C++ header OUTPUT holding it as a byte array
+file(READ ${INPUT} content HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${content}")
+
+file(WRITE ${OUTPUT}
+    "// Generated from lge_runtime.c, do not edit\n"
+    "#pragma once\n\n"
+    "namespace lge {\n\n"
+    "inline constexpr unsigned char runtimeBitcode[] = {${bytes}};\n\n"
+    "} // namespace lge\n"
+)
@@ -3,40 +3,709 @@
     Provides implementations for built-in functions
 ********************************/
 
-#include <limits.h>
+#include "lge_runtime.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define LGE_X86_KERNELS 1
+#endif
+
+/******************************
+    Runtime context
+    Builtins never touch globals, only the context bound to their thread
+********************************/
+
+#define ARENA_BLOCK_SIZE 4096
+#define ARENA_ALIGN 8
+
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+  char data[];
+} arena_block;
+
+struct lge_context {
+  arena_block *arena; // Backs every string returned by builtins
+  FILE *in;
+  FILE *out;
+};
+
+static _Thread_local lge_context *current_context;
+static _Thread_local lge_context *default_context;
+
+// Only used to free a thread's default context when the thread exits
+static tss_t default_context_key;
+static once_flag default_context_once = ONCE_FLAG_INIT;
+
+static void destroy_default_context(void *ctx) { lge_context_destroy(ctx); }
+
+static void create_default_context_key(void) {
+  tss_create(&default_context_key, destroy_default_context);
+}
+
+static lge_context *get_context(void) {
+  if (current_context)
+    return current_context;
+
+  if (!default_context) {
+    call_once(&default_context_once, create_default_context_key);
+    default_context = lge_context_create(stdin, stdout);
+    tss_set(default_context_key, default_context);
+  }
+
+  current_context = default_context;
+  return current_context;
+}
+
+static char *arena_alloc(lge_context *ctx, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  arena_block *block = ctx->arena;
+  if (!block || block->size - block->used < size) {
+    const size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+    block = malloc(sizeof(arena_block) + block_size);
+    if (!block) {
+      fputs("LGE runtime: out of memory\n", stderr);
+      abort();
+    }
+
+    block->next = ctx->arena;
+    block->size = block_size;
+    block->used = 0;
+    ctx->arena = block;
+  }
+
+  char *ptr = block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+static char *arena_strndup(lge_context *ctx, const char *str, size_t len) {
+  char *copy = arena_alloc(ctx, len + 1);
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+lge_context *lge_context_create(FILE *in, FILE *out) {
+  lge_context *ctx = calloc(1, sizeof(lge_context));
+  if (!ctx)
+    return NULL;
+
+  ctx->in = in ? in : stdin;
+  ctx->out = out ? out : stdout;
+  return ctx;
+}
+
+void lge_context_reset(lge_context *ctx) {
+  arena_block *block = ctx->arena;
+  while (block) {
+    arena_block *next = block->next;
+    free(block);
+    block = next;
+  }
+  ctx->arena = NULL;
+}
+
+void lge_context_destroy(lge_context *ctx) {
+  if (!ctx)
+    return;
+
+  if (current_context == ctx)
+    current_context = NULL;
+  if (default_context == ctx)
+    default_context = NULL;
+
+  lge_context_reset(ctx);
+  free(ctx);
+}
+
+lge_context *lge_context_bind(lge_context *ctx) {
+  lge_context *previous = current_context;
+  current_context = ctx;
+  return previous;
+}
+
+void *lge_alloc(size_t size) { return arena_alloc(get_context(), size); }
+
+/******************************
+    Parallel loops and tasks
+    A process wide pool of workers, each with a deque of index ranges and
+    one of tasks. The owner splits ranges in half from the back of its
+    deque, idle workers steal the largest remaining range from the front of
+    another's. Tasks are pushed and popped at the back too, stolen oldest
+    first. Threads that aren't workers share the first deques.
+********************************/
+
+#define DEQUE_CAPACITY 64 // Halving an int range never needs more than 33
+#define CHUNKS_PER_THREAD 8
+#define TASKS_PER_THREAD 2 // Queued tasks beyond this run right away
+#define MAX_THREADS 256
+
+typedef void (*lge_range_fn)(void *env, int begin, int end);
+
+typedef struct {
+  int begin;
+  int end;
+} index_range;
+
+typedef struct {
+  mtx_t lock;
+  index_range ranges[DEQUE_CAPACITY];
+  int head; // Stolen from here
+  int tail; // Pushed and popped here
+} range_deque;
+
+typedef struct {
+  void (*fn)(void *env);
+  void *env;
+  atomic_int done;
+} lge_task;
+
+typedef struct {
+  mtx_t lock;
+  lge_task **tasks;
+  int capacity;
+  int head; // Stolen from here
+  int tail; // Pushed and popped here
+} task_deque;
+
+typedef struct {
+  lge_range_fn body;
+  void *env;
+  int grain; // Ranges up to this size are not split further
+  atomic_int remaining;
+} parallel_job;
+
+static struct {
+  int thread_count; // Workers plus the calling thread, deque 0 is the caller's
+  range_deque *deques;
+  task_deque *task_deques;
+  atomic_int queued_tasks; // In any task deque
+  atomic_int sleeping;     // Workers waiting for a job or a task
+
+  mtx_t submit; // One job at a time, other callers run their loop alone
+  mtx_t lock;
+  cnd_t wake;
+  cnd_t idle;
+  parallel_job *job;
+  unsigned generation;
+  int active; // Workers inside the current job
+} pool;
+
+static once_flag pool_once = ONCE_FLAG_INIT;
+
+// Set on workers and on a caller while its job runs, nested loops run inline
+static _Thread_local int in_parallel_loop;
+
+// Deques of the calling thread, 0 unless it is a worker
+static _Thread_local int worker_index;
+
+static int deque_pop(range_deque *deque, index_range *range) {
+  mtx_lock(&deque->lock);
+  const int found = deque->tail > deque->head;
+  if (found)
+    *range = deque->ranges[--deque->tail];
+  mtx_unlock(&deque->lock);
+  return found;
+}
+
+static int deque_steal(range_deque *deque, index_range *range) {
+  mtx_lock(&deque->lock);
+  const int found = deque->tail > deque->head;
+  if (found)
+    *range = deque->ranges[deque->head++];
+  mtx_unlock(&deque->lock);
+  return found;
+}
+
+// False if the deque is full, the range is then run without splitting
+static int deque_push(range_deque *deque, index_range range) {
+  mtx_lock(&deque->lock);
+  if (deque->head == deque->tail) {
+    deque->head = deque->tail = 0;
+  } else if (deque->tail == DEQUE_CAPACITY && deque->head > 0) {
+    memmove(deque->ranges, deque->ranges + deque->head,
+            (deque->tail - deque->head) * sizeof(index_range));
+    deque->tail -= deque->head;
+    deque->head = 0;
+  }
+
+  const int pushed = deque->tail < DEQUE_CAPACITY;
+  if (pushed)
+    deque->ranges[deque->tail++] = range;
+  mtx_unlock(&deque->lock);
+  return pushed;
+}
+
+static void run_job(parallel_job *job, int self) {
+  while (atomic_load_explicit(&job->remaining, memory_order_acquire) > 0) {
+    index_range range;
+    int found = deque_pop(&pool.deques[self], &range);
+    for (int i = 1; !found && i < pool.thread_count; i++) {
+      found = deque_steal(&pool.deques[(self + i) % pool.thread_count], &range);
+    }
+
+    // The last ranges are still running elsewhere
+    if (!found) {
+      thrd_yield();
+      continue;
+    }
+
+    // The upper halves stay available to thieves
+    while (range.end - range.begin > job->grain) {
+      const int mid = range.begin + (range.end - range.begin) / 2;
+      if (!deque_push(&pool.deques[self], (index_range){mid, range.end}))
+        break;
+      range.end = mid;
+    }
+
+    job->body(job->env, range.begin, range.end);
+    atomic_fetch_sub_explicit(&job->remaining, range.end - range.begin, memory_order_release);
+  }
+}
+
+static int task_push(task_deque *deque, lge_task *task) {
+  mtx_lock(&deque->lock);
+  if (deque->head == deque->tail) {
+    deque->head = deque->tail = 0;
+  }
+
+  if (deque->tail == deque->capacity) {
+    const int capacity = deque->capacity ? deque->capacity * 2 : 64;
+    lge_task **tasks = realloc(deque->tasks, capacity * sizeof(lge_task *));
+    if (!tasks) {
+      mtx_unlock(&deque->lock);
+      return 0;
+    }
+    deque->tasks = tasks;
+    deque->capacity = capacity;
+  }
+
+  deque->tasks[deque->tail++] = task;
+  mtx_unlock(&deque->lock);
+  atomic_fetch_add(&pool.queued_tasks, 1);
+  return 1;
+}
+
+// Takes task back if nobody has started it yet
+static int task_take_back(task_deque *deque, lge_task *task) {
+  mtx_lock(&deque->lock);
+  const int found = deque->tail > deque->head && deque->tasks[deque->tail - 1] == task;
+  if (found)
+    deque->tail--;
+  mtx_unlock(&deque->lock);
+
+  if (found)
+    atomic_fetch_sub(&pool.queued_tasks, 1);
+  return found;
+}
+
+static lge_task *task_steal(int self) {
+  for (int i = 1; i <= pool.thread_count; i++) {
+    task_deque *deque = &pool.task_deques[(self + i) % pool.thread_count];
+
+    mtx_lock(&deque->lock);
+    lge_task *task = deque->tail > deque->head ? deque->tasks[deque->head++] : NULL;
+    mtx_unlock(&deque->lock);
+
+    if (task) {
+      atomic_fetch_sub(&pool.queued_tasks, 1);
+      return task;
+    }
+  }
+  return NULL;
+}
+
+static void run_task(lge_task *task) {
+  task->fn(task->env);
+  atomic_store_explicit(&task->done, 1, memory_order_release);
+}
+
+static int worker_main(void *arg) {
+  const int self = (int)(intptr_t)arg;
+  worker_index = self;
+
+  // Nothing allocated by a loop body or a task outlives it (results are
+  // scalars), it all goes back once the job or task is done
+  lge_context *ctx = lge_context_create(NULL, NULL);
+  lge_context_bind(ctx);
+  in_parallel_loop = 1;
+
+  unsigned seen = 0;
+  for (;;) {
+    lge_task *task = task_steal(self);
+    if (task) {
+      run_task(task);
+      lge_context_reset(ctx);
+      continue;
+    }
+
+    mtx_lock(&pool.lock);
+    atomic_fetch_add(&pool.sleeping, 1);
+    while (pool.generation == seen && atomic_load(&pool.queued_tasks) == 0) {
+      cnd_wait(&pool.wake, &pool.lock);
+    }
+    atomic_fetch_sub(&pool.sleeping, 1);
+
+    parallel_job *job = pool.generation != seen ? pool.job : NULL;
+    seen = pool.generation;
+    if (!job) {
+      mtx_unlock(&pool.lock);
+      continue;
+    }
+    pool.active++;
+    mtx_unlock(&pool.lock);
+
+    run_job(job, self);
+    lge_context_reset(ctx);
+
+    mtx_lock(&pool.lock);
+    if (--pool.active == 0)
+      cnd_broadcast(&pool.idle);
+    mtx_unlock(&pool.lock);
+  }
+  return 0;
+}
+
+// LGE_NUM_THREADS, or one thread per online processor
+static int configured_thread_count(void) {
+  const char *env = getenv("LGE_NUM_THREADS");
+  long count = env ? strtol(env, NULL, 10) : 0;
+  if (count < 1)
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (count < 1)
+    count = 1;
+  return count > MAX_THREADS ? MAX_THREADS : (int)count;
+}
 
-#undef MIN
-#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+static void create_pool(void) {
+  pool.thread_count = configured_thread_count();
+  pool.deques = calloc(pool.thread_count, sizeof(range_deque));
+  pool.task_deques = calloc(pool.thread_count, sizeof(task_deque));
+  if (!pool.deques || !pool.task_deques) {
+    pool.thread_count = 1;
+    return;
+  }
+
+  mtx_init(&pool.submit, mtx_plain);
+  mtx_init(&pool.lock, mtx_plain);
+  cnd_init(&pool.wake);
+  cnd_init(&pool.idle);
+  for (int i = 0; i < pool.thread_count; i++) {
+    mtx_init(&pool.deques[i].lock, mtx_plain);
+    mtx_init(&pool.task_deques[i].lock, mtx_plain);
+  }
+
+  // Fewer workers than asked for only means less parallelism
+  for (int i = 1; i < pool.thread_count; i++) {
+    thrd_t thread;
+    if (thrd_create(&thread, worker_main, (void *)(intptr_t)i) != thrd_success) {
+      pool.thread_count = i;
+      break;
+    }
+    thrd_detach(thread);
+  }
+}
+
+void lge_parallel_for(int n, lge_range_fn body, void *env) {
+  if (n <= 0)
+    return;
+
+  call_once(&pool_once, create_pool);
+  if (pool.thread_count == 1 || n == 1 || in_parallel_loop ||
+      mtx_trylock(&pool.submit) != thrd_success) {
+    body(env, 0, n);
+    return;
+  }
+
+  parallel_job job = {.body = body, .env = env};
+  const int chunks = pool.thread_count * CHUNKS_PER_THREAD;
+  job.grain = n / chunks > 0 ? n / chunks : 1;
+  atomic_init(&job.remaining, n);
+
+  // An even share per thread up front, stealing balances the rest
+  for (int i = 0; i < pool.thread_count; i++) {
+    const int begin = (int)((long long)n * i / pool.thread_count);
+    const int end = (int)((long long)n * (i + 1) / pool.thread_count);
+    if (begin < end)
+      deque_push(&pool.deques[i], (index_range){begin, end});
+  }
+
+  mtx_lock(&pool.lock);
+  pool.job = &job;
+  pool.generation++;
+  cnd_broadcast(&pool.wake);
+  mtx_unlock(&pool.lock);
+
+  in_parallel_loop = 1;
+  run_job(&job, 0);
+  in_parallel_loop = 0;
+
+  // job lives on this stack, no worker may still be looking at it
+  mtx_lock(&pool.lock);
+  while (pool.active > 0) {
+    cnd_wait(&pool.idle, &pool.lock);
+  }
+  pool.job = NULL;
+  mtx_unlock(&pool.lock);
+
+  mtx_unlock(&pool.submit);
+}
+
+void *lge_task_spawn(void (*fn)(void *env), void *env) {
+  call_once(&pool_once, create_pool);
+
+  // Every worker has something to do already, splitting further only costs
+  lge_task *task = NULL;
+  if (pool.thread_count > 1 &&
+      atomic_load(&pool.queued_tasks) < pool.thread_count * TASKS_PER_THREAD) {
+    task = malloc(sizeof(lge_task));
+  }
+  if (task) {
+    task->fn = fn;
+    task->env = env;
+    atomic_init(&task->done, 0);
+    if (!task_push(&pool.task_deques[worker_index], task)) {
+      free(task);
+      task = NULL;
+    }
+  }
+
+  if (!task) {
+    fn(env);
+    return NULL;
+  }
+
+  if (atomic_load(&pool.sleeping) > 0) {
+    mtx_lock(&pool.lock);
+    cnd_signal(&pool.wake);
+    mtx_unlock(&pool.lock);
+  }
+  return task;
+}
+
+void lge_task_wait(void *handle) {
+  lge_task *task = handle;
+  if (!task)
+    return;
+
+  // Tasks spawned after this one have been waited for, so unless it was
+  // stolen it is still at the back of the deque
+  if (task_take_back(&pool.task_deques[worker_index], task)) {
+    run_task(task);
+  }
+
+  while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+    lge_task *other = task_steal(worker_index);
+    if (other) {
+      run_task(other);
+    } else {
+      thrd_yield();
+    }
+  }
+  free(task);
+}
+
+/******************************
+    String kernels
+    Picked once at load time based on the CPU (AVX2 > SSE2 > scalar)
+********************************/
+
+static size_t strlen_scalar(const char *str) { return strlen(str); }
+
+// First-char filter: jump between occurrences of needle[0] with memchr
+static const char *search_scalar(const char *hay, size_t hay_len, const char *needle,
+                                 size_t needle_len) {
+  if (needle_len > hay_len)
+    return NULL;
+
+  const char *end = hay + (hay_len - needle_len) + 1;
+  for (const char *p = hay; p < end; p++) {
+    p = memchr(p, needle[0], end - p);
+    if (!p)
+      return NULL;
+    if (memcmp(p + 1, needle + 1, needle_len - 1) == 0)
+      return p;
+  }
+
+  return NULL;
+}
+
+#ifdef LGE_X86_KERNELS
+// Aligned loads never cross a page boundary, so reading the whole block
+// that contains the terminator is safe even past the end of the string.
+__attribute__((target("sse2"))) static size_t strlen_sse2(const char *str) {
+  const __m128i zero = _mm_setzero_si128();
+  const size_t misalign = (uintptr_t)str & 15;
+  const char *p = str - misalign;
+
+  unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+  mask >>= misalign;
+  if (mask)
+    return __builtin_ctz(mask);
+
+  for (p += 16;; p += 16) {
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+    if (mask)
+      return (size_t)(p - str) + __builtin_ctz(mask);
+  }
+}
+
+__attribute__((target("avx2"))) static size_t strlen_avx2(const char *str) {
+  const __m256i zero = _mm256_setzero_si256();
+  const size_t misalign = (uintptr_t)str & 31;
+  const char *p = str - misalign;
+
+  unsigned mask =
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)p), zero));
+  mask >>= misalign;
+  if (mask)
+    return __builtin_ctz(mask);
+
+  for (p += 32;; p += 32) {
+    mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)p), zero));
+    if (mask)
+      return (size_t)(p - str) + __builtin_ctz(mask);
+  }
+}
+
+// SIMD first/last-char filter: a block of candidate positions is kept only
+// where both needle[0] and needle[len - 1] match, then verified with memcmp.
+__attribute__((target("sse2"))) static const char *
+search_sse2(const char *hay, size_t hay_len, const char *needle, size_t needle_len) {
+  if (needle_len > hay_len)
+    return NULL;
+
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+
+  size_t i = 0;
+  for (; i + needle_len + 15 <= hay_len; i += 16) {
+    const __m128i blockFirst = _mm_loadu_si128((const __m128i *)(hay + i));
+    const __m128i blockLast = _mm_loadu_si128((const __m128i *)(hay + i + needle_len - 1));
+    unsigned mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast)));
+
+    while (mask) {
+      const unsigned bit = __builtin_ctz(mask);
+      if (memcmp(hay + i + bit + 1, needle + 1, needle_len - 1) == 0)
+        return hay + i + bit;
+      mask &= mask - 1;
+    }
+  }
+
+  return search_scalar(hay + i, hay_len - i, needle, needle_len);
+}
+
+__attribute__((target("avx2"))) static const char *
+search_avx2(const char *hay, size_t hay_len, const char *needle, size_t needle_len) {
+  if (needle_len > hay_len)
+    return NULL;
 
-#define BUFFER_SIZE UCHAR_MAX
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
 
-static char glob_buffer[BUFFER_SIZE]; // TODO have heap alloc mem
+  size_t i = 0;
+  for (; i + needle_len + 31 <= hay_len; i += 32) {
+    const __m256i blockFirst = _mm256_loadu_si256((const __m256i *)(hay + i));
+    const __m256i blockLast = _mm256_loadu_si256((const __m256i *)(hay + i + needle_len - 1));
+    unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst),
+                                                          _mm256_cmpeq_epi8(last, blockLast)));
+
+    while (mask) {
+      const unsigned bit = __builtin_ctz(mask);
+      if (memcmp(hay + i + bit + 1, needle + 1, needle_len - 1) == 0)
+        return hay + i + bit;
+      mask &= mask - 1;
+    }
+  }
+
+  return search_scalar(hay + i, hay_len - i, needle, needle_len);
+}
+
+// Queried with cpuid directly instead of __builtin_cpu_supports so the
+// runtime does not depend on libgcc/compiler-rt when linked as bitcode.
+static int cpu_has_sse2(void) {
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+  return (edx & bit_SSE2) != 0;
+}
+
+static int cpu_has_avx2(void) {
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+  if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+    return 0;
+
+  // The OS must save the YMM state (XCR0 bits 1 and 2)
+  unsigned xcr0_lo, xcr0_hi;
+  __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+  if ((xcr0_lo & 6) != 6)
+    return 0;
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return 0;
+  return (ebx & bit_AVX2) != 0;
+}
+#endif
+
+static struct {
+  size_t (*len)(const char *);
+  const char *(*search)(const char *, size_t, const char *, size_t);
+} kernels = {strlen_scalar, search_scalar};
+
+__attribute__((constructor)) static void select_kernels(void) {
+#ifdef LGE_X86_KERNELS
+  if (cpu_has_avx2()) {
+    kernels.len = strlen_avx2;
+    kernels.search = search_avx2;
+  } else if (cpu_has_sse2()) {
+    kernels.len = strlen_sse2;
+    kernels.search = search_sse2;
+  }
+#endif
+}
 
 int str_print(const char *str) {
-  fputs(str, stdout);
+  fputs(str, get_context()->out);
   return 0;
 }
 
 char *str_read(int n) {
-  // n must be less then BUFFER_SIZE
-  n = MIN(BUFFER_SIZE, n + 1);
-  glob_buffer[0] = '\0';
+  lge_context *ctx = get_context();
+  if (n < 0)
+    n = 0;
 
-  if (fgets(glob_buffer, n, stdin)) {
+  char *buffer = arena_alloc(ctx, (size_t)n + 1);
+  buffer[0] = '\0';
+
+  if (fgets(buffer, n + 1, ctx->in)) {
     // Remove newline if present
-    const size_t len = strlen(glob_buffer);
-    if (len > 0 && glob_buffer[len - 1] == '\n') {
-      glob_buffer[len - 1] = '\0';
+    const size_t len = strlen(buffer);
+    if (len > 0 && buffer[len - 1] == '\n') {
+      buffer[len - 1] = '\0';
     }
   }
 
-  return glob_buffer;
+  return buffer;
 }
 
-int str_len(const char *str) { return (int)strlen(str); }
+int str_len(const char *str) { return (int)kernels.len(str); }
 
 char str_at(const char *str, int index) {
   if (!str || index < 0 || index >= strlen(str)) {
@@ -46,31 +715,37 @@ char str_at(const char *str, int index) {
 }
 
 char *str_sub(const char *str, int start, int end) {
-  glob_buffer[0] = '\0';
+  lge_context *ctx = get_context();
   if (!str)
-    return glob_buffer;
+    return arena_strndup(ctx, "", 0);
 
-  int len = strlen(str);
+  int len = kernels.len(str);
   if (start < 0 || end < start || start >= len) {
-    return glob_buffer; // Return empty string
+    return arena_strndup(ctx, "", 0); // Return empty string
   }
 
   if (end > len)
     end = len;
 
-  int sublen = end - start;
-
-  strncpy(glob_buffer, str + start, sublen);
-  glob_buffer[sublen] = '\0';
-
-  return glob_buffer;
+  return arena_strndup(ctx, str + start, end - start);
 }
 
-int str_find(const char *haystack, const char *needle) {
+int str_find_from(const char *haystack, const char *needle, int start) {
   if (!haystack || !needle)
     return -1;
 
-  char *found = strstr(haystack, needle);
+  const size_t hay_len = kernels.len(haystack);
+  if (start < 0)
+    start = 0;
+  if ((size_t)start > hay_len)
+    return -1;
+
+  const size_t needle_len = kernels.len(needle);
+  if (needle_len == 0)
+    return start;
+
+  const char *found =
+      kernels.search(haystack + start, hay_len - start, needle, needle_len);
   if (found) {
     return found - haystack;
   }
@@ -78,9 +753,14 @@ int str_find(const char *haystack, const char *needle) {
   return -1;
 }
 
+int str_find(const char *haystack, const char *needle) {
+  return str_find_from(haystack, needle, 0);
+}
+
 char *int_to_str(int value) {
-  sprintf(glob_buffer, "%d", value);
-  return glob_buffer;
+  char buffer[16];
+  const int len = snprintf(buffer, sizeof(buffer), "%d", value);
+  return arena_strndup(get_context(), buffer, len);
 }
 
 int str_to_int(const char *str) {
@@ -90,8 +770,10 @@ int str_to_int(const char *str) {
 }
 
 char *float_to_str(float value) {
-  sprintf(glob_buffer, "%f", value);
-  return glob_buffer;
+  // %f of FLT_MAX is 46 chars
+  char buffer[64];
+  const int len = snprintf(buffer, sizeof(buffer), "%f", value);
+  return arena_strndup(get_context(), buffer, len);
 }
 
 float str_to_float(const char *str) {
@@ -100,6 +782,35 @@ float str_to_float(const char *str) {
   return atof(str);
 }
 
+char *i64_to_str(int64_t value) {
+  char buffer[24];
+  const int len = snprintf(buffer, sizeof(buffer), "%" PRId64, value);
+  return arena_strndup(get_context(), buffer, len);
+}
+
+int64_t str_to_i64(const char *str) {
+  if (!str)
+    return 0;
+  return strtoll(str, NULL, 10);
+}
+
+char *f64_to_str(double value) {
+  // Enough digits to tell apart doubles that print the same with %f
+  char buffer[32];
+  const int len = snprintf(buffer, sizeof(buffer), "%.15g", value);
+  return arena_strndup(get_context(), buffer, len);
+}
+
+double str_to_f64(const char *str) {
+  if (!str)
+    return 0.0;
+  return strtod(str, NULL);
+}
+
 int str_cmp(const char *a, const char *b) {
-  return strcmp(a, b) == 0;
+  // Strings of different lengths can never be equal
+  const size_t len = kernels.len(a);
+  if (len != kernels.len(b))
+    return 0;
+  return memcmp(a, b, len) == 0;
 }
@@ -0,0 +1,74 @@
+/******************************
+    LGE Runtime Library
+    Public interface for hosts embedding compiled LGE programs
+********************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Everything a builtin touches (string allocations, input and output streams)
+  lives in a context. Each thread gets a default context on first use, so
+  plain `lli -load` runs need no setup. Hosts evaluating many programs
+  concurrently create one context per evaluation and bind it to the thread
+  running it.
+*/
+typedef struct lge_context lge_context;
+
+// NULL streams default to stdin/stdout
+lge_context *lge_context_create(FILE *in, FILE *out);
+void lge_context_destroy(lge_context *ctx);
+
+// Frees every string handed out by builtins running on this context
+void lge_context_reset(lge_context *ctx);
+
+// Binds ctx to the calling thread and returns the previously bound one
+// (NULL => fall back to the thread's default context)
+lge_context *lge_context_bind(lge_context *ctx);
+
+// Memory from the bound context's arena, freed by lge_context_reset. Backs
+// arrays built by compiled code.
+void *lge_alloc(size_t size);
+
+// Calls body(env, begin, end) for chunks covering [0, n) on a pool of worker
+// threads and returns once all of them are done. The pool has
+// LGE_NUM_THREADS threads (default: one per processor), the caller
+// included. Loops started inside a body, or while another thread's loop
+// runs, run on the calling thread alone. Memory a body allocates on a
+// worker is freed when the loop ends. Backs par_map and par_reduce.
+void lge_parallel_for(int n, void (*body)(void *env, int begin, int end), void *env);
+
+// Fork-join tasks on the same pool (--auto-par). fn(env) may run on another
+// thread until lge_task_wait returns, or right away when enough tasks are
+// queued already (the handle is NULL then). Every spawn must be waited for,
+// the most recent first.
+void *lge_task_spawn(void (*fn)(void *env), void *env);
+void lge_task_wait(void *task);
+
+// Built-in functions
+int str_print(const char *str);
+char *str_read(int n);
+int str_len(const char *str);
+char str_at(const char *str, int index);
+char *str_sub(const char *str, int start, int end);
+int str_find(const char *haystack, const char *needle);
+int str_find_from(const char *haystack, const char *needle, int start);
+char *int_to_str(int value);
+int str_to_int(const char *str);
+char *float_to_str(float value);
+float str_to_float(const char *str);
+char *i64_to_str(int64_t value);
+int64_t str_to_i64(const char *str);
+char *f64_to_str(double value);
+double str_to_f64(const char *str);
+int str_cmp(const char *a, const char *b);
+
+#ifdef __cplusplus
+}
+#endif
@@ -31,6 +31,44 @@ std::string Type::toString() const {
     result += returnType ? returnType->toString() : "void";
     return result;
   }
+  case ARRAY:
+    return "[" + elementType->toString() + "]";
+  case I8:
+    return "i8";
+  case I16:
+    return "i16";
+  case I64:
+    return "i64";
+  case F64:
+    return "f64";
+  case VEC4F:
+    return "vec4f";
+  case VEC8F:
+    return "vec8f";
+  case VEC4I:
+    return "vec4i";
+  case VEC8I:
+    return "vec8i";
+  case TUPLE: {
+    std::string result = "(";
+    for (size_t i = 0; i < fieldTypes.size(); i++) {
+      if (i > 0)
+        result += ", ";
+      result += fieldTypes[i]->toString();
+    }
+    return result + ")";
+  }
+  case RECORD: {
+    std::string result = "{";
+    for (size_t i = 0; i < fieldTypes.size(); i++) {
+      if (i > 0)
+        result += ", ";
+      result += fieldNames[i] + ": " + fieldTypes[i]->toString();
+    }
+    return result + "}";
+  }
+  case BOOL:
+    return "bool";
   }
   return "unknown";
 }
@@ -50,6 +88,11 @@ void FloatLiteral::dump(int indent) const {
   std::cout << indentStr << "FloatLiteral: " << value << std::endl;
 }
 
+void BoolLiteral::dump(int indent) const {
+  std::string indentStr(indent * 2, ' ');
+  std::cout << indentStr << "BoolLiteral: " << (value ? "true" : "false") << std::endl;
+}
+
 void Identifier::dump(int indent) const {
   std::string indentStr(indent * 2, ' ');
   std::cout << indentStr << "Identifier: " << name << std::endl;
@@ -62,6 +105,9 @@ void UnaryOp::dump(int indent) const {
   case NEG:
     std::cout << "-";
     break;
+  case NOT:
+    std::cout << "not";
+    break;
   }
   std::cout << std::endl;
   operand->dump(indent + 1);
@@ -101,6 +147,30 @@ void BinaryOp::dump(int indent) const {
   case NOT_EQUAL:
     std::cout << "!=";
     break;
+  case AND:
+    std::cout << "and";
+    break;
+  case OR:
+    std::cout << "or";
+    break;
+  case MOD:
+    std::cout << "%";
+    break;
+  case BIT_AND:
+    std::cout << "&";
+    break;
+  case BIT_OR:
+    std::cout << "|";
+    break;
+  case BIT_XOR:
+    std::cout << "^";
+    break;
+  case SHL:
+    std::cout << "<<";
+    break;
+  case SHR:
+    std::cout << ">>";
+    break;
   }
   std::cout << std::endl;
   left->dump(indent + 1);
@@ -149,6 +219,70 @@ void ConditionalExpression::dump(int indent) const {
   elseExpr->dump(indent + 2);
 }
 
+void ArrayLiteral::dump(int indent) const {
+  std::string indentStr(indent * 2, ' ');
+  std::cout << indentStr << "ArrayLiteral:" << std::endl;
+
+  for (const auto &element : elements) {
+    element->dump(indent + 1);
+  }
+}
+
+void IndexExpression::dump(int indent) const {
+  std::string indentStr(indent * 2, ' ');
+  std::cout << indentStr << "IndexExpression:" << std::endl;
+  std::cout << indentStr << " Array:" << std::endl;
+  array->dump(indent + 2);
+  std::cout << indentStr << " Index:" << std::endl;
+  index->dump(indent + 2);
+}
+
+void RecordLiteral::dump(int indent) const {
+  std::string indentStr(indent * 2, ' ');
+  std::cout << indentStr << (fieldNames.empty() ? "TupleLiteral:" : "RecordLiteral:") << std::endl;
+
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (!fieldNames.empty()) {
+      std::cout << indentStr << " " << fieldNames[i] << ":" << std::endl;
+    }
+    fields[i]->dump(indent + 1);
+  }
+}
+
+void FieldAccess::dump(int indent) const {
+  std::string indentStr(indent * 2, ' ');
+  std::cout << indentStr << "FieldAccess: " << field << std::endl;
+  record->dump(indent + 1);
+}
+
+void LetExpression::dump(int indent) const {
+  std::string indentStr(indent * 2, ' ');
+  std::cout << indentStr << "LetExpression:";
+  for (size_t i = 0; i < names.size(); i++) {
+    std::cout << (i == 0 ? (destructure ? " (" : " ") : ", ") << names[i];
+  }
+  std::cout << (destructure ? ")" : "") << std::endl;
+  std::cout << indentStr << " Value:" << std::endl;
+  value->dump(indent + 2);
+  std::cout << indentStr << " Body:" << std::endl;
+  body->dump(indent + 2);
+}
+
+void MatchExpression::dump(int indent) const {
+  std::string indentStr(indent * 2, ' ');
+  std::cout << indentStr << "MatchExpression:" << std::endl;
+  std::cout << indentStr << " Subject:" << std::endl;
+  subject->dump(indent + 2);
+  for (const auto &arm : arms) {
+    std::cout << indentStr << (arm.patterns.empty() ? " Default:" : " Arm:") << std::endl;
+    for (const auto &pattern : arm.patterns) {
+      pattern->dump(indent + 2);
+    }
+    std::cout << indentStr << " Body:" << std::endl;
+    arm.body->dump(indent + 2);
+  }
+}
+
 void Program::dump(int indent) const {
   std::string indentStr(indent * 2, ' ');
   std::cout << indentStr << "Program:" << std::endl;
@@ -0,0 +1,555 @@
+#include "ast_format.h"
+
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/LEB128.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace lge {
+
+namespace {
+constexpr char magic[8] = {'L', 'G', 'E', 'A', 'S', 'T', '\0', '\0'};
+
+enum NodeTag : uint8_t {
+  INT_LITERAL = 1,
+  FLOAT_LITERAL,
+  STRING_LITERAL,
+  IDENTIFIER,
+  UNARY_OP,
+  BINARY_OP,
+  FUNCTION_CALL,
+  CONDITIONAL,
+  ARRAY_LITERAL,
+  INDEX,
+  RECORD_LITERAL,
+  FIELD_ACCESS,
+  LET,
+  MATCH,
+  BOOL_LITERAL
+};
+
+class ASTWriter {
+public:
+  // Nodes are encoded first, the tables are only complete afterwards
+  std::string nodes;
+  llvm::raw_string_ostream out{nodes};
+
+  std::vector<const std::string *> strings;
+  std::vector<uint32_t> files;
+
+  void number(uint64_t value) { llvm::encodeULEB128(value, out); }
+
+  void string(const std::string &value) { number(stringIndex(value)); }
+
+  void location(const Location &loc) {
+    auto [it, inserted] = fileIds.try_emplace(loc.filename, files.size());
+    if (inserted) {
+      files.push_back(stringIndex(loc.filename));
+    }
+    number(it->second);
+    number(loc.line);
+    number(loc.column);
+  }
+
+  void type(const Type &type) {
+    number(type.kind);
+    location(type.location);
+    number(type.paramTypes.size());
+    for (const auto &param : type.paramTypes) {
+      this->type(*param);
+    }
+    number(type.returnType ? 1 : 0);
+    if (type.returnType) {
+      this->type(*type.returnType);
+    }
+    number(type.elementType ? 1 : 0);
+    if (type.elementType) {
+      this->type(*type.elementType);
+    }
+    number(type.fieldTypes.size());
+    for (const auto &field : type.fieldTypes) {
+      this->type(*field);
+    }
+    number(type.fieldNames.size());
+    for (const auto &name : type.fieldNames) {
+      string(name);
+    }
+  }
+
+  void expression(const Expression &expr) {
+    if (const auto *intLit = dynamic_cast<const IntLiteral *>(&expr)) {
+      out << char(INT_LITERAL);
+      location(expr.location);
+      llvm::encodeSLEB128(intLit->value, out);
+    } else if (const auto *floatLit = dynamic_cast<const FloatLiteral *>(&expr)) {
+      out << char(FLOAT_LITERAL);
+      location(expr.location);
+      char bytes[8];
+      llvm::support::endian::write64le(bytes, std::bit_cast<uint64_t>(floatLit->value));
+      out.write(bytes, sizeof(bytes));
+    } else if (const auto *boolLit = dynamic_cast<const BoolLiteral *>(&expr)) {
+      out << char(BOOL_LITERAL);
+      location(expr.location);
+      number(boolLit->value ? 1 : 0);
+    } else if (const auto *strLit = dynamic_cast<const StringLiteral *>(&expr)) {
+      out << char(STRING_LITERAL);
+      location(expr.location);
+      string(strLit->value);
+    } else if (const auto *ident = dynamic_cast<const Identifier *>(&expr)) {
+      out << char(IDENTIFIER);
+      location(expr.location);
+      string(ident->name);
+    } else if (const auto *unaryOp = dynamic_cast<const UnaryOp *>(&expr)) {
+      out << char(UNARY_OP);
+      location(expr.location);
+      number(unaryOp->op);
+      expression(*unaryOp->operand);
+    } else if (const auto *binOp = dynamic_cast<const BinaryOp *>(&expr)) {
+      out << char(BINARY_OP);
+      location(expr.location);
+      number(binOp->op);
+      expression(*binOp->left);
+      expression(*binOp->right);
+    } else if (const auto *call = dynamic_cast<const FunctionCall *>(&expr)) {
+      out << char(FUNCTION_CALL);
+      location(expr.location);
+      string(call->funcName);
+      number(call->args.size());
+      for (const auto &arg : call->args) {
+        expression(*arg);
+      }
+    } else if (const auto *condExpr = dynamic_cast<const ConditionalExpression *>(&expr)) {
+      out << char(CONDITIONAL);
+      location(expr.location);
+      expression(*condExpr->condition);
+      expression(*condExpr->thenExpr);
+      expression(*condExpr->elseExpr);
+    } else if (const auto *arrayLit = dynamic_cast<const ArrayLiteral *>(&expr)) {
+      out << char(ARRAY_LITERAL);
+      location(expr.location);
+      number(arrayLit->elements.size());
+      for (const auto &element : arrayLit->elements) {
+        expression(*element);
+      }
+    } else if (const auto *indexExpr = dynamic_cast<const IndexExpression *>(&expr)) {
+      out << char(INDEX);
+      location(expr.location);
+      expression(*indexExpr->array);
+      expression(*indexExpr->index);
+    } else if (const auto *recordLit = dynamic_cast<const RecordLiteral *>(&expr)) {
+      out << char(RECORD_LITERAL);
+      location(expr.location);
+      number(recordLit->fieldNames.size());
+      for (const auto &name : recordLit->fieldNames) {
+        string(name);
+      }
+      number(recordLit->fields.size());
+      for (const auto &field : recordLit->fields) {
+        expression(*field);
+      }
+    } else if (const auto *fieldAccess = dynamic_cast<const FieldAccess *>(&expr)) {
+      out << char(FIELD_ACCESS);
+      location(expr.location);
+      string(fieldAccess->field);
+      expression(*fieldAccess->record);
+    } else if (const auto *letExpr = dynamic_cast<const LetExpression *>(&expr)) {
+      out << char(LET);
+      location(expr.location);
+      number(letExpr->destructure ? 1 : 0);
+      number(letExpr->names.size());
+      for (const auto &name : letExpr->names) {
+        string(name);
+      }
+      expression(*letExpr->value);
+      expression(*letExpr->body);
+    } else if (const auto *matchExpr = dynamic_cast<const MatchExpression *>(&expr)) {
+      out << char(MATCH);
+      location(expr.location);
+      expression(*matchExpr->subject);
+      number(matchExpr->arms.size());
+      for (const auto &arm : matchExpr->arms) {
+        location(arm.location);
+        number(arm.patterns.size());
+        for (const auto &pattern : arm.patterns) {
+          expression(*pattern);
+        }
+        expression(*arm.body);
+      }
+    } else {
+      throw std::runtime_error("AST writer can't encode expression");
+    }
+  }
+
+  void function(const FunctionDef &func) {
+    string(func.name);
+    location(func.location);
+    type(*func.returnType);
+    number(func.parameters.size());
+    for (const auto &param : func.parameters) {
+      string(param.name);
+      location(param.location);
+      type(*param.type);
+    }
+    expression(*func.body);
+  }
+
+private:
+  std::unordered_map<std::string, uint32_t> stringIds;
+  std::unordered_map<std::string, uint32_t> fileIds;
+
+  uint32_t stringIndex(const std::string &value) {
+    auto [it, inserted] = stringIds.try_emplace(value, strings.size());
+    if (inserted) {
+      strings.push_back(&it->first);
+    }
+    return it->second;
+  }
+};
+
+class ASTReader {
+public:
+  ASTReader(const llvm::MemoryBuffer &buffer)
+      : name(buffer.getBufferIdentifier().str()),
+        pos(reinterpret_cast<const uint8_t *>(buffer.getBufferStart())),
+        end(reinterpret_cast<const uint8_t *>(buffer.getBufferEnd())) {}
+
+  std::shared_ptr<Program> program() {
+    if (size_t(end - pos) < sizeof(magic) + 4 || std::memcmp(pos, magic, sizeof(magic)) != 0) {
+      fail("not an LGE AST file");
+    }
+    pos += sizeof(magic);
+
+    const uint32_t version = llvm::support::endian::read32le(pos);
+    pos += 4;
+    if (version != astFormatVersion) {
+      fail("unsupported format version " + std::to_string(version) + " (expected " +
+           std::to_string(astFormatVersion) + ")");
+    }
+
+    strings.resize(count());
+    for (auto &value : strings) {
+      const size_t length = count();
+      value = llvm::StringRef(reinterpret_cast<const char *>(pos), length);
+      pos += length;
+    }
+
+    files.resize(count());
+    for (auto &file : files) {
+      file = string().str();
+    }
+
+    auto result = std::make_shared<Program>(Location(1, 1, files.empty() ? "" : files.front()));
+    result->functions.resize(count());
+    for (auto &func : result->functions) {
+      func = function();
+    }
+
+    if (pos != end) {
+      fail("trailing data");
+    }
+    return result;
+  }
+
+private:
+  std::string name;
+  const uint8_t *pos;
+  const uint8_t *end;
+  std::vector<llvm::StringRef> strings; // Point into the buffer
+  std::vector<std::string> files;
+
+  [[noreturn]] void fail(const std::string &message) const {
+    throw std::runtime_error("Invalid AST file " + name + ": " + message);
+  }
+
+  uint64_t number() {
+    unsigned length = 0;
+    const char *error = nullptr;
+    const uint64_t value = llvm::decodeULEB128(pos, &length, end, &error);
+    if (error) {
+      fail(error);
+    }
+    pos += length;
+    return value;
+  }
+
+  // A count of items that each take at least one byte
+  size_t count() {
+    const uint64_t value = number();
+    if (value > uint64_t(end - pos)) {
+      fail("truncated");
+    }
+    return value;
+  }
+
+  int64_t signedNumber() {
+    unsigned length = 0;
+    const char *error = nullptr;
+    const int64_t value = llvm::decodeSLEB128(pos, &length, end, &error);
+    if (error) {
+      fail(error);
+    }
+    pos += length;
+    return value;
+  }
+
+  uint8_t byte() {
+    if (pos == end) {
+      fail("truncated");
+    }
+    return *pos++;
+  }
+
+  llvm::StringRef string() {
+    const uint64_t index = number();
+    if (index >= strings.size()) {
+      fail("string index out of range");
+    }
+    return strings[index];
+  }
+
+  Location location() {
+    const uint64_t file = number();
+    if (file >= files.size()) {
+      fail("file index out of range");
+    }
+    const size_t line = number();
+    const size_t column = number();
+    return Location(line, column, files[file]);
+  }
+
+  TypePtr type() {
+    const uint64_t kind = number();
+    if (kind > Type::BOOL) {
+      fail("unknown type kind");
+    }
+    auto result = std::make_unique<Type>(static_cast<Type::TypeKind>(kind), location());
+    result->paramTypes.resize(count());
+    for (auto &param : result->paramTypes) {
+      param = type();
+    }
+    if (number()) {
+      result->returnType = type();
+    }
+    if (number()) {
+      result->elementType = type();
+    }
+    result->fieldTypes.resize(count());
+    for (auto &field : result->fieldTypes) {
+      field = type();
+    }
+    result->fieldNames.resize(count());
+    for (auto &name : result->fieldNames) {
+      name = string().str();
+    }
+    // Code generation relies on records naming every field
+    if (result->kind == Type::RECORD ? result->fieldNames.size() != result->fieldTypes.size()
+                                     : !result->fieldNames.empty()) {
+      fail("record field names don't match its fields");
+    }
+    return result;
+  }
+
+  ExprPtr expression() {
+    const uint8_t tag = byte();
+    const Location loc = location();
+
+    switch (tag) {
+    case INT_LITERAL:
+      return std::make_unique<IntLiteral>(signedNumber(), loc);
+    case FLOAT_LITERAL: {
+      if (end - pos < 8) {
+        fail("truncated");
+      }
+      const uint64_t bits = llvm::support::endian::read64le(pos);
+      pos += 8;
+      return std::make_unique<FloatLiteral>(std::bit_cast<double>(bits), loc);
+    }
+    case BOOL_LITERAL:
+      return std::make_unique<BoolLiteral>(number() != 0, loc);
+    case STRING_LITERAL:
+      return std::make_unique<StringLiteral>(string().str(), loc);
+    case IDENTIFIER:
+      return std::make_unique<Identifier>(string().str(), loc);
+    case UNARY_OP: {
+      const uint64_t op = number();
+      if (op > UnaryOp::NOT) {
+        fail("unknown unary operator");
+      }
+      return std::make_unique<UnaryOp>(static_cast<UnaryOp::OpType>(op), expression(), loc);
+    }
+    case BINARY_OP: {
+      const uint64_t op = number();
+      if (op > BinaryOp::SHR) {
+        fail("unknown binary operator");
+      }
+      auto left = expression();
+      auto right = expression();
+      return std::make_unique<BinaryOp>(static_cast<BinaryOp::OpType>(op), std::move(left),
+                                        std::move(right), loc);
+    }
+    case FUNCTION_CALL: {
+      const std::string funcName = string().str();
+      std::vector<ExprPtr> args(count());
+      for (auto &arg : args) {
+        arg = expression();
+      }
+      return std::make_unique<FunctionCall>(funcName, std::move(args), loc);
+    }
+    case CONDITIONAL: {
+      auto condition = expression();
+      auto thenExpr = expression();
+      auto elseExpr = expression();
+      return std::make_unique<ConditionalExpression>(std::move(condition), std::move(thenExpr),
+                                                     std::move(elseExpr), loc);
+    }
+    case ARRAY_LITERAL: {
+      std::vector<ExprPtr> elements(count());
+      for (auto &element : elements) {
+        element = expression();
+      }
+      return std::make_unique<ArrayLiteral>(std::move(elements), loc);
+    }
+    case INDEX: {
+      auto array = expression();
+      auto index = expression();
+      return std::make_unique<IndexExpression>(std::move(array), std::move(index), loc);
+    }
+    case RECORD_LITERAL: {
+      std::vector<std::string> names(count());
+      for (auto &name : names) {
+        name = string().str();
+      }
+      std::vector<ExprPtr> fields(count());
+      for (auto &field : fields) {
+        field = expression();
+      }
+      if (!names.empty() && names.size() != fields.size()) {
+        fail("record field names don't match its fields");
+      }
+      return std::make_unique<RecordLiteral>(std::move(names), std::move(fields), loc);
+    }
+    case FIELD_ACCESS: {
+      const std::string field = string().str();
+      return std::make_unique<FieldAccess>(expression(), field, loc);
+    }
+    case LET: {
+      const bool destructure = number() != 0;
+      std::vector<std::string> names(count());
+      for (auto &name : names) {
+        name = string().str();
+      }
+      if (names.empty() || (!destructure && names.size() != 1)) {
+        fail("let binds no or too many names");
+      }
+      auto value = expression();
+      auto body = expression();
+      return std::make_unique<LetExpression>(std::move(names), destructure, std::move(value),
+                                             std::move(body), loc);
+    }
+    case MATCH: {
+      auto subject = expression();
+      const size_t armCount = count();
+      std::vector<MatchArm> arms;
+      for (size_t i = 0; i < armCount; i++) {
+        const Location armLoc = location();
+        std::vector<ExprPtr> patterns(count());
+        for (auto &pattern : patterns) {
+          pattern = expression();
+          if (!dynamic_cast<IntLiteral *>(pattern.get()) &&
+              !dynamic_cast<StringLiteral *>(pattern.get())) {
+            fail("match pattern is not a literal");
+          }
+        }
+        // Only the last arm is `_`, code generation relies on it
+        if (patterns.empty() != (i + 1 == armCount)) {
+          fail("match arms don't end with '_'");
+        }
+        auto body = expression();
+        arms.emplace_back(std::move(patterns), std::move(body), armLoc);
+      }
+      if (arms.empty()) {
+        fail("match has no arms");
+      }
+      return std::make_unique<MatchExpression>(std::move(subject), std::move(arms), loc);
+    }
+    default:
+      fail("unknown node " + std::to_string(tag));
+    }
+  }
+
+  FuncDefPtr function() {
+    const std::string funcName = string().str();
+    const Location loc = location();
+    auto returnType = type();
+
+    std::vector<Parameter> params;
+    const size_t paramCount = count();
+    for (size_t i = 0; i < paramCount; i++) {
+      const std::string paramName = string().str();
+      const Location paramLoc = location();
+      params.emplace_back(paramName, type(), paramLoc);
+    }
+
+    auto body = expression();
+    return std::make_shared<FunctionDef>(funcName, std::move(returnType), std::move(params),
+                                         std::move(body), loc);
+  }
+};
+} // namespace
+
+bool isASTFile(const std::string &filename) {
+  return llvm::sys::path::extension(filename) == ".lgeast";
+}
+
+void writeAST(const Program &program, const std::string &outputFile) {
+  ASTWriter writer;
+  writer.number(program.functions.size());
+  for (const auto &func : program.functions) {
+    writer.function(*func);
+  }
+  writer.out.flush();
+
+  std::error_code error;
+  llvm::raw_fd_ostream out(outputFile.empty() ? "-" : outputFile, error, llvm::sys::fs::OF_None);
+  if (error) {
+    throw std::runtime_error("Could not open " + outputFile + ": " + error.message());
+  }
+
+  char version[4];
+  llvm::support::endian::write32le(version, astFormatVersion);
+  out.write(magic, sizeof(magic));
+  out.write(version, sizeof(version));
+
+  llvm::encodeULEB128(writer.strings.size(), out);
+  for (const auto *value : writer.strings) {
+    llvm::encodeULEB128(value->size(), out);
+    out << *value;
+  }
+
+  llvm::encodeULEB128(writer.files.size(), out);
+  for (uint32_t file : writer.files) {
+    llvm::encodeULEB128(file, out);
+  }
+
+  out << writer.nodes;
+}
+
+std::shared_ptr<Program> readAST(const std::string &filename) {
+  // Large files are memory mapped, nothing has to be null terminated
+  auto buffer = llvm::MemoryBuffer::getFile(filename, false, false);
+  if (!buffer) {
+    throw std::runtime_error("Could not read " + filename + ": " + buffer.getError().message());
+  }
+
+  return ASTReader(**buffer).program();
+}
+
+} // namespace lge
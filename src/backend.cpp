@@ -0,0 +1,122 @@
+#include "backend.h"
+
+#include <stdexcept>
+
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "optimizer.h"
+
+namespace lge {
+
+void emitModule(llvm::Module &module, EmitKind kind, const std::string &outputFile) {
+  std::error_code error;
+  llvm::raw_fd_ostream out(outputFile.empty() ? "-" : outputFile, error, llvm::sys::fs::OF_None);
+  if (error) {
+    throw std::runtime_error("Could not open " + outputFile + ": " + error.message());
+  }
+
+  switch (kind) {
+  case EmitKind::LLVM:
+    module.print(out, nullptr);
+    return;
+  case EmitKind::BITCODE:
+    llvm::WriteBitcodeToFile(module, out);
+    return;
+  case EmitKind::ASSEMBLY:
+  case EmitKind::OBJECT:
+    break;
+  }
+
+  auto targetMachine = createHostTargetMachine();
+  module.setTargetTriple(targetMachine->getTargetTriple().str());
+  module.setDataLayout(targetMachine->createDataLayout());
+
+  const auto fileType = kind == EmitKind::OBJECT ? llvm::CodeGenFileType::ObjectFile
+                                                 : llvm::CodeGenFileType::AssemblyFile;
+
+  llvm::legacy::PassManager passManager;
+  if (targetMachine->addPassesToEmitFile(passManager, out, nullptr, fileType)) {
+    throw std::runtime_error("Target can't emit a file of this type");
+  }
+  passManager.run(module);
+}
+
+std::unique_ptr<llvm::orc::LLJIT> createJIT(const std::vector<std::string> &libraries,
+                                            bool fastCodeGen) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  for (const auto &library : libraries) {
+    std::string error;
+    if (llvm::sys::DynamicLibrary::LoadLibraryPermanently(library.c_str(), &error)) {
+      throw std::runtime_error("Could not load " + library + ": " + error);
+    }
+  }
+
+  auto targetMachineBuilder = llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!targetMachineBuilder) {
+    throw std::runtime_error(llvm::toString(targetMachineBuilder.takeError()));
+  }
+  if (fastCodeGen) {
+    targetMachineBuilder->setCodeGenOptLevel(llvm::CodeGenOptLevel::None);
+  }
+
+  auto jit = llvm::orc::LLJITBuilder()
+                 .setJITTargetMachineBuilder(std::move(*targetMachineBuilder))
+                 .create();
+  if (!jit) {
+    throw std::runtime_error("Failed to create JIT: " + llvm::toString(jit.takeError()));
+  }
+
+  // Builtins and libc come from the process and the libraries loaded above
+  auto processSymbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*jit)->getDataLayout().getGlobalPrefix());
+  if (!processSymbols) {
+    throw std::runtime_error(llvm::toString(processSymbols.takeError()));
+  }
+  (*jit)->getMainJITDylib().addGenerator(std::move(*processSymbols));
+
+  return std::move(*jit);
+}
+
+int runModule(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context,
+              const std::vector<std::string> &libraries) {
+  auto jit = createJIT(libraries);
+
+  if (module->getDataLayout().isDefault()) {
+    module->setDataLayout(jit->getDataLayout());
+  }
+
+  if (auto error = jit->addIRModule(
+          llvm::orc::ThreadSafeModule(std::move(module), std::move(context)))) {
+    throw std::runtime_error(llvm::toString(std::move(error)));
+  }
+
+  // Runs static constructors, e.g. the kernel selection of a linked runtime
+  if (auto error = jit->initialize(jit->getMainJITDylib())) {
+    throw std::runtime_error(llvm::toString(std::move(error)));
+  }
+
+  auto mainSymbol = jit->lookup("main");
+  if (!mainSymbol) {
+    throw std::runtime_error("No main function: " + llvm::toString(mainSymbol.takeError()));
+  }
+
+  auto *mainFunc = mainSymbol->toPtr<int (*)()>();
+  const int result = mainFunc();
+
+  if (auto error = jit->deinitialize(jit->getMainJITDylib())) {
+    throw std::runtime_error(llvm::toString(std::move(error)));
+  }
+
+  return result;
+}
+
+} // namespace lge
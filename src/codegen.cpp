@@ -1,31 +1,238 @@
 #include "codegen.h"
 
+#include <cctype>
 #include <iostream>
+#include <map>
+#include <optional>
 #include <sstream>
+#include <unordered_set>
 
+#include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/TimeProfiler.h>
 #include <llvm/Support/raw_ostream.h>
 
 namespace lge {
 
-CodeGenerator::CodeGenerator() {
-  module = std::make_unique<llvm::Module>("LGE Module", context);
-  builder = std::make_unique<llvm::IRBuilder<>>(context);
+namespace {
+// Lowered inline, they are generic over the array's element type
+const std::unordered_set<std::string> arrayBuiltins = {
+    "len", "array_int", "array_float", "array_range", "sum",
+    "map", "fold", "zip_with", "par_map", "par_reduce"};
+
+// Explicit numeric conversions, lowered inline for any numeric argument
+const std::unordered_set<std::string> conversionBuiltins = {"to_i8",  "to_i16", "to_i32",
+                                                            "to_i64", "to_f32", "to_f64"};
+
+// Lowered inline, generic over the vector type
+const std::unordered_set<std::string> vectorBuiltins = {
+    "splat4f", "splat8f", "splat4i", "splat8i", "pack4f",     "pack8f",     "pack4i",
+    "pack8i",  "extract", "insert",  "select",  "reduce_add", "reduce_min", "reduce_max",
+    "any",     "all"};
+
+// Value of an integer literal, negated or not
+std::optional<int64_t> integerLiteral(const Expression &expr) {
+  if (const auto *intLit = dynamic_cast<const IntLiteral *>(&expr)) {
+    return intLit->value;
+  }
+  const auto *unaryOp = dynamic_cast<const UnaryOp *>(&expr);
+  if (unaryOp && unaryOp->op == UnaryOp::NEG) {
+    if (const auto *intLit = dynamic_cast<const IntLiteral *>(unaryOp->operand.get())) {
+      return -intLit->value;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<double> floatLiteral(const Expression &expr) {
+  if (const auto *floatLit = dynamic_cast<const FloatLiteral *>(&expr)) {
+    return floatLit->value;
+  }
+  const auto *unaryOp = dynamic_cast<const UnaryOp *>(&expr);
+  if (unaryOp && unaryOp->op == UnaryOp::NEG) {
+    if (const auto *floatLit = dynamic_cast<const FloatLiteral *>(unaryOp->operand.get())) {
+      return -floatLit->value;
+    }
+  }
+  return std::nullopt;
+}
+
+// par_reduce folds at most this many blocks, each on one thread
+constexpr int reduceBlocks = 256;
+
+// Both operands must cost at least this much to be worth a task (--auto-par)
+constexpr uint64_t spawnThreshold = 1000;
+
+// What str_at returns
+const Type charType(Type::CHAR, Location());
+} // namespace
+
+CodeGenerator::CodeGenerator(const CodeGenOptions &options)
+    : context(std::make_unique<llvm::LLVMContext>()), options(options) {
+  module = std::make_unique<llvm::Module>("LGE Module", *context);
+  builder = std::make_unique<llvm::IRBuilder<>>(*context);
 
   declareBuiltinFunctions();
 }
 
 void CodeGenerator::generate(const Program &program) {
+  std::vector<const FunctionDef *> bodies;
+  for (const auto &func : program.functions) {
+    bodies.push_back(func.get());
+  }
+  const PurityAnalysis programPurity(program);
+  const CostModel programCosts = options.autoParallel ? CostModel(program) : CostModel();
+  generate(program, bodies, programPurity, programCosts);
+}
+
+void CodeGenerator::generate(const Program &program,
+                             const std::vector<const FunctionDef *> &bodies,
+                             const PurityAnalysis &purity, const CostModel &costModel) {
+  this->purity = &purity;
+  this->costModel = &costModel;
+  const std::unordered_set<const FunctionDef *> emitBody(bodies.begin(), bodies.end());
+
+  // Register every definition first, so bodies can call functions defined
+  // later in the file, in another input file or in another shard
+  std::vector<const FunctionDef *> owned;
   for (const auto &func : program.functions) {
+    const bool ownsBody = emitBody.contains(func.get());
+    if (registerFunction(*func, ownsBody) && ownsBody) {
+      owned.push_back(func.get());
+    }
+  }
+
+  // Own prototypes go first in program order, functions defined elsewhere
+  // are only declared once they are referenced
+  std::vector<const FunctionDef *> declared;
+  for (const auto *func : owned) {
+    if (declareFunction(*func)) {
+      declared.push_back(func);
+    }
+  }
+
+  for (const auto *func : declared) {
     generateFunction(*func);
   }
+  applyTargetCPU();
+}
+
+void CodeGenerator::generateEvaluation(const Program &program, const std::string &name,
+                                       const Expression &expr) {
+  const PurityAnalysis programPurity(program);
+  const CostModel programCosts = options.autoParallel ? CostModel(program) : CostModel();
+  purity = &programPurity;
+  costModel = &programCosts;
+  for (const auto &func : program.functions) {
+    registerFunction(*func, false);
+  }
+
+  llvm::FunctionType *funcType = llvm::FunctionType::get(llvm::Type::getVoidTy(*context), false);
+  llvm::Function *function =
+      llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, name, module.get());
+
+  builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", function));
+  currentFunction = function;
+  namedValues.clear();
+
+  llvm::Value *value = generateExpression(expr);
+  if (!value) {
+    function->eraseFromParent();
+    return;
+  }
+
+  // printf format by the value's type, functions print nothing. char and i8
+  // are both i8, only a declared char prints as a character.
+  auto formatOf = [&](llvm::Value *&scalar, const Type *declared) -> const char * {
+    llvm::Type *type = scalar->getType();
+    if (type->isIntegerTy(1)) {
+      scalar =
+          builder->CreateSelect(scalar, internString("true"), internString("false"), "booltmp");
+      return "%s";
+    } else if (type->isIntegerTy(8) && declared && declared->kind == Type::CHAR) {
+      return "%c";
+    } else if (type->isIntegerTy(64)) {
+      return "%lld";
+    } else if (type->isIntegerTy()) {
+      scalar = builder->CreateSExtOrTrunc(scalar, llvm::Type::getInt32Ty(*context), "sexttmp");
+      return "%d";
+    } else if (type->isFloatingPointTy()) {
+      scalar = builder->CreateFPExt(scalar, llvm::Type::getDoubleTy(*context), "fpexttmp");
+      return type->isDoubleTy() ? "%.15g" : "%g";
+    } else if (type->isPointerTy() && !llvm::isa<llvm::Function>(scalar->stripPointerCasts())) {
+      return "%s";
+    }
+    return nullptr;
+  };
+
+  // Vectors print as <lane, lane, ...>, tuples as (a, b, ...) and records
+  // as {name: a, ...}. The declared type of a field comes from the whole
+  // value's, or from the field's expression in a literal.
+  std::string format;
+  std::vector<llvm::Value *> printArgs;
+  std::function<bool(llvm::Value *, const Expression *, const Type *)> append =
+      [&](llvm::Value *part, const Expression *partExpr, const Type *declared) {
+    if (!declared && partExpr) {
+      declared = declaredType(*partExpr);
+    }
+
+    if (auto *vectorType = llvm::dyn_cast<llvm::FixedVectorType>(part->getType())) {
+      format += "<";
+      for (unsigned i = 0; i < vectorType->getNumElements(); i++) {
+        llvm::Value *lane = builder->CreateExtractElement(part, i, "lane");
+        format += (i > 0 ? ", " : "") + std::string(formatOf(lane, nullptr));
+        printArgs.push_back(lane);
+      }
+      format += ">";
+      return true;
+    }
+
+    if (const auto *fieldNames = recordFieldNames(part->getType())) {
+      const auto *literal = dynamic_cast<const RecordLiteral *>(partExpr);
+      const unsigned fieldCount = part->getType()->getStructNumElements();
+      const bool declaresFields = declared && declared->fieldTypes.size() == fieldCount;
+
+      format += fieldNames->empty() ? "(" : "{";
+      for (unsigned i = 0; i < fieldCount; i++) {
+        format += i > 0 ? ", " : "";
+        format += fieldNames->empty() ? "" : (*fieldNames)[i] + ": ";
+        if (!append(builder->CreateExtractValue(part, i, "field"),
+                    literal ? literal->fields[i].get() : nullptr,
+                    declaresFields ? declared->fieldTypes[i].get() : nullptr))
+          return false;
+      }
+      format += fieldNames->empty() ? ")" : "}";
+      return true;
+    }
+
+    const char *scalarFormat = formatOf(part, declared);
+    if (!scalarFormat)
+      return false;
+    format += scalarFormat;
+    printArgs.push_back(part);
+    return true;
+  };
+
+  if (append(value, &expr, nullptr) && !printArgs.empty()) {
+    llvm::Type *strType = llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0);
+    llvm::FunctionCallee printfFunc = module->getOrInsertFunction(
+        "printf", llvm::FunctionType::get(llvm::Type::getInt32Ty(*context), {strType}, true));
+    printArgs.insert(printArgs.begin(), internString(format + "\n"));
+    builder->CreateCall(printfFunc, printArgs);
+  }
+  builder->CreateRetVoid();
+  applyTargetCPU();
+}
 
-  // Verify the module
+bool CodeGenerator::verify() {
   std::string errorString;
   llvm::raw_string_ostream errorStream(errorString);
   if (llvm::verifyModule(*module, &errorStream)) {
     std::cerr << "Module verification failed: " << errorString << std::endl;
+    return false;
   }
+  return true;
 }
 
 void CodeGenerator::emitIR() { module->print(llvm::outs(), nullptr); }
@@ -40,18 +247,65 @@ std::string CodeGenerator::getIR() {
 llvm::Type *CodeGenerator::llvmType(const Type &type) {
   switch (type.kind) {
   case Type::INT:
-    return llvm::Type::getInt32Ty(context);
+    return llvm::Type::getInt32Ty(*context);
   case Type::FLOAT:
-    return llvm::Type::getFloatTy(context);
+    return llvm::Type::getFloatTy(*context);
   case Type::CHAR:
-    return llvm::Type::getInt8Ty(context);
+  case Type::I8:
+    return llvm::Type::getInt8Ty(*context);
+  case Type::I16:
+    return llvm::Type::getInt16Ty(*context);
+  case Type::BOOL:
+    return llvm::Type::getInt1Ty(*context);
+  case Type::I64:
+    return llvm::Type::getInt64Ty(*context);
+  case Type::F64:
+    return llvm::Type::getDoubleTy(*context);
+  case Type::VEC4F:
+    return llvm::FixedVectorType::get(llvm::Type::getFloatTy(*context), 4);
+  case Type::VEC8F:
+    return llvm::FixedVectorType::get(llvm::Type::getFloatTy(*context), 8);
+  case Type::VEC4I:
+    return llvm::FixedVectorType::get(llvm::Type::getInt32Ty(*context), 4);
+  case Type::VEC8I:
+    return llvm::FixedVectorType::get(llvm::Type::getInt32Ty(*context), 8);
   case Type::STR:
-    return llvm::PointerType::get(llvm::Type::getInt8Ty(context),
+    return llvm::PointerType::get(llvm::Type::getInt8Ty(*context),
                                   0); // char*
   case Type::FUNC:
     // In a more sophisticated impl, we would need to
     // track the specific fn signature
-    return llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0);
+    return llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0);
+  case Type::ARRAY: {
+    llvm::Type *elementType = llvmType(*type.elementType);
+    if (!elementType)
+      return nullptr;
+    if (!elementType->isIntegerTy(32) && !elementType->isFloatTy()) {
+      reportError("Arrays of " + type.elementType->toString() + " are not supported",
+                  type.location);
+      return nullptr;
+    }
+    return arrayType(elementType);
+  }
+  case Type::TUPLE:
+  case Type::RECORD: {
+    std::vector<llvm::Type *> fieldTypes;
+    for (const auto &field : type.fieldTypes) {
+      llvm::Type *fieldType = llvmType(*field);
+      if (!fieldType)
+        return nullptr;
+      fieldTypes.push_back(fieldType);
+    }
+    for (size_t i = 0; i < type.fieldNames.size(); i++) {
+      for (size_t j = 0; j < i; j++) {
+        if (type.fieldNames[i] == type.fieldNames[j]) {
+          reportError("Duplicate record field " + type.fieldNames[i], type.location);
+          return nullptr;
+        }
+      }
+    }
+    return recordType(fieldTypes, type.fieldNames);
+  }
   default:
     reportError("Unknown type", type.location);
     return nullptr;
@@ -61,15 +315,23 @@ llvm::Type *CodeGenerator::llvmType(const Type &type) {
 llvm::Value *CodeGenerator::generateExpression(const Expression &expr) {
   // Handle different expr types
   if (const auto *intLit = dynamic_cast<const IntLiteral *>(&expr)) {
-    return llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), intLit->value);
+    // int unless it needs more bits, convertTo narrows it where needed
+    llvm::Type *type = llvm::isIntN(32, intLit->value) ? llvm::Type::getInt32Ty(*context)
+                                                       : llvm::Type::getInt64Ty(*context);
+    return llvm::ConstantInt::get(type, intLit->value, true);
   }
 
   if (const auto *floatLit = dynamic_cast<const FloatLiteral *>(&expr)) {
-    return llvm::ConstantFP::get(llvm::Type::getFloatTy(context), floatLit->value);
+    // Kept as a double, convertTo re-emits it exactly for f64
+    return llvm::ConstantFP::get(llvm::Type::getFloatTy(*context), floatLit->value);
   }
 
   if (const auto *strLit = dynamic_cast<const StringLiteral *>(&expr)) {
-    return builder->CreateGlobalStringPtr(strLit->value, "str");
+    return internString(strLit->value);
+  }
+
+  if (const auto *boolLit = dynamic_cast<const BoolLiteral *>(&expr)) {
+    return llvm::ConstantInt::getBool(*context, boolLit->value);
   }
 
   if (const auto *ident = dynamic_cast<const Identifier *>(&expr)) {
@@ -80,11 +342,10 @@ llvm::Value *CodeGenerator::generateExpression(const Expression &expr) {
     }
 
     // Check if this is a function ref
-    auto funcIt = functions.find(ident->name);
-    if (funcIt != functions.end()) {
+    if (llvm::Function *func = lookupFunction(ident->name)) {
       // Return function ptr
-      return builder->CreateBitCast(funcIt->second,
-                                    llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0));
+      return builder->CreateBitCast(func,
+                                    llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0));
     }
 
     reportError("Undefined variable: " + ident->name, ident->location);
@@ -92,98 +353,176 @@ llvm::Value *CodeGenerator::generateExpression(const Expression &expr) {
   }
 
   if (const auto *unaryOp = dynamic_cast<const UnaryOp *>(&expr)) {
+    if (unaryOp->op == UnaryOp::NOT) {
+      llvm::Value *condition = generateCondition(*unaryOp->operand, "not");
+      return condition ? builder->CreateNot(condition, "nottmp") : nullptr;
+    }
+
     llvm::Value *operand = generateExpression(*unaryOp->operand);
     if (!operand)
       return nullptr;
 
     switch (unaryOp->op) {
     case UnaryOp::NEG:
-      if (operand->getType()->isIntegerTy()) {
+      if (operand->getType()->isIntOrIntVectorTy()) {
         return builder->CreateNeg(operand, "negtmp");
-      } else if (operand->getType()->isFloatingPointTy()) {
+      } else if (operand->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFNeg(operand, "fnegtmp");
       }
       break;
+    case UnaryOp::NOT:
+      break;
     }
   }
 
   if (const auto *binOp = dynamic_cast<const BinaryOp *>(&expr)) {
-    llvm::Value *left = generateExpression(*binOp->left);
-    llvm::Value *right = generateExpression(*binOp->right);
+    // The right operand of and/or may not run at all, it is never spawned
+    if (binOp->op == BinaryOp::AND || binOp->op == BinaryOp::OR) {
+      return generateShortCircuit(*binOp);
+    }
+
+    // An expensive pure call on the left may run on another thread while
+    // the right operand is evaluated
+    llvm::Value *left = nullptr, *right = nullptr;
+    if (const FunctionCall *spawnable = spawnableOperand(*binOp)) {
+      auto task = spawnCall(*spawnable);
+      if (!task)
+        return nullptr;
+      right = generateExpression(*binOp->right);
+      left = joinTask(*task);
+    } else {
+      left = generateExpression(*binOp->left);
+      right = generateExpression(*binOp->right);
+    }
 
     if (!left || !right)
       return nullptr;
 
+    if (!unifyOperands(left, *binOp->left, right, *binOp->right)) {
+      reportError("Unsupported binary operation between " +
+                      typeName(left->getType(), *binOp->left) + " and " +
+                      typeName(right->getType(), *binOp->right),
+                  binOp->location);
+      return nullptr;
+    }
+
+    // Bools are 0 or 1 in arithmetic and ordering, as i1 they would wrap
+    // around and compare signed. Bitwise operators keep them bools.
+    const bool keepsBools = binOp->op == BinaryOp::EQUAL_EQUAL ||
+                            binOp->op == BinaryOp::NOT_EQUAL || binOp->op == BinaryOp::BIT_AND ||
+                            binOp->op == BinaryOp::BIT_OR || binOp->op == BinaryOp::BIT_XOR;
+    if (left->getType()->isIntegerTy(1) && !keepsBools) {
+      left = builder->CreateZExt(left, builder->getInt32Ty(), "zexttmp");
+      right = builder->CreateZExt(right, builder->getInt32Ty(), "zexttmp");
+    }
+
     switch (binOp->op) {
     case BinaryOp::ADD:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateAdd(left, right, "addtmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFAdd(left, right, "faddtmp");
       }
       break;
     case BinaryOp::SUB:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateSub(left, right, "subtmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFSub(left, right, "fsubtmp");
       }
       break;
     case BinaryOp::MUL:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateMul(left, right, "multmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFMul(left, right, "fmultmp");
       }
       break;
     case BinaryOp::DIV:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateSDiv(left, right, "divtmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFDiv(left, right, "fdivtmp");
       }
     case BinaryOp::LESS_THAN:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateICmpSLT(left, right, "cmptmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFCmpOLT(left, right, "cmptmp");
       }
       break;
     case BinaryOp::GREATER_THAN:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateICmpSGT(left, right, "cmptmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFCmpOGT(left, right, "cmptmp");
       }
       break;
     case BinaryOp::LESS_EQUAL:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateICmpSLE(left, right, "cmptmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFCmpOLE(left, right, "cmptmp");
       }
       break;
     case BinaryOp::GREATER_EQUAL:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateICmpSGE(left, right, "cmptmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFCmpOGE(left, right, "cmptmp");
       }
       break;
     case BinaryOp::EQUAL_EQUAL:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateICmpEQ(left, right, "cmptmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFCmpOEQ(left, right, "cmptmp");
       }
       break;
     case BinaryOp::NOT_EQUAL:
-      if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
         return builder->CreateICmpNE(left, right, "cmptmp");
-      } else if (left->getType()->isFloatingPointTy() && right->getType()->isFloatingPointTy()) {
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
         return builder->CreateFCmpONE(left, right, "cmptmp");
       }
       break;
+    case BinaryOp::MOD:
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
+        return builder->CreateSRem(left, right, "modtmp");
+      } else if (left->getType()->isFPOrFPVectorTy() && right->getType()->isFPOrFPVectorTy()) {
+        return builder->CreateFRem(left, right, "fmodtmp");
+      }
+      break;
+    case BinaryOp::BIT_AND:
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
+        return builder->CreateAnd(left, right, "andtmp");
+      }
+      break;
+    case BinaryOp::BIT_OR:
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
+        return builder->CreateOr(left, right, "ortmp");
+      }
+      break;
+    case BinaryOp::BIT_XOR:
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
+        return builder->CreateXor(left, right, "xortmp");
+      }
+      break;
+    case BinaryOp::SHL:
+    case BinaryOp::SHR:
+      if (left->getType()->isIntOrIntVectorTy() && right->getType()->isIntOrIntVectorTy()) {
+        // Amounts past the bit width would be poison, they wrap around like
+        // on x86 instead, where the mask folds into the shift
+        const unsigned bits = left->getType()->getScalarSizeInBits();
+        llvm::Value *amount =
+            builder->CreateAnd(right, llvm::ConstantInt::get(right->getType(), bits - 1), "shamt");
+        return binOp->op == BinaryOp::SHL ? builder->CreateShl(left, amount, "shltmp")
+                                          : builder->CreateAShr(left, amount, "shrtmp");
+      }
+      break;
+    case BinaryOp::AND:
+    case BinaryOp::OR:
+      break;
     }
 
     reportError("Unsupported binary operation", binOp->location);
@@ -212,7 +551,7 @@ llvm::Value *CodeGenerator::generateExpression(const Expression &expr) {
       }
 
       // Determine ret type based on ctx (assume int)
-      llvm::Type *returnType = llvm::Type::getInt32Ty(context);
+      llvm::Type *returnType = llvm::Type::getInt32Ty(*context);
       llvm::FunctionType *funcType = llvm::FunctionType::get(returnType, argTypes, false);
 
       // Cast the func ptr and create indirect call
@@ -221,12 +560,18 @@ llvm::Value *CodeGenerator::generateExpression(const Expression &expr) {
       return builder->CreateCall(funcType, castedFunc, args, "calltmp");
     }
 
-    llvm::Function *func = nullptr;
-
-    auto it = functions.find(call->funcName);
-    if (it != functions.end()) {
-      func = it->second;
-    } else {
+    llvm::Function *func = lookupFunction(call->funcName);
+    const bool isBuiltin = !func;
+    if (isBuiltin && arrayBuiltins.contains(call->funcName)) {
+      return generateArrayBuiltin(*call);
+    }
+    if (isBuiltin && conversionBuiltins.contains(call->funcName)) {
+      return generateConversion(*call);
+    }
+    if (isBuiltin && vectorBuiltins.contains(call->funcName)) {
+      return generateVectorBuiltin(*call);
+    }
+    if (isBuiltin) {
       // Check for built in funx
       func = module->getFunction(call->funcName);
     }
@@ -247,38 +592,46 @@ llvm::Value *CodeGenerator::generateExpression(const Expression &expr) {
       llvm::Value *argValue = generateExpression(*arg);
       if (!argValue)
         return nullptr;
+
+      llvm::Type *paramType = func->getArg(args.size())->getType();
+      argValue = convertTo(argValue, *arg, paramType);
+      if (argValue->getType() != paramType) {
+        auto definition = definitions.find(call->funcName);
+        const std::string expected =
+            definition != definitions.end()
+                ? definition->second->parameters[args.size()].type->toString()
+                : typeName(paramType);
+        reportError("Argument " + std::to_string(args.size() + 1) + " of " + call->funcName +
+                        " is " + typeName(argValue->getType(), *arg) + ", expected " + expected,
+                    arg->location);
+        return nullptr;
+      }
       args.push_back(argValue);
     }
 
+    // Builtins with a known inline lowering skip the runtime call
+    if (isBuiltin) {
+      if (llvm::Value *lowered = lowerBuiltinCall(*call, args)) {
+        return lowered;
+      }
+    }
+
     return builder->CreateCall(func, args, "calltmp");
   }
 
   if (const auto *condExpr = dynamic_cast<const ConditionalExpression *>(&expr)) {
-    llvm::Value *condition = generateExpression(*condExpr->condition);
-    if (!condition)
-      return nullptr;
-
-    // Convert condition to boolean (i1)
-    llvm::Value *condBool = nullptr;
-    if (condition->getType()->isIntegerTy()) {
-      condBool = builder->CreateICmpNE(condition, llvm::ConstantInt::get(condition->getType(), 0),
-                                       "ifcond");
-    } else if (condition->getType()->isFloatingPointTy()) {
-      condBool = builder->CreateFCmpONE(condition, llvm::ConstantFP::get(condition->getType(), 0.0),
-                                        "ifcond");
-    } else {
-      reportError("Invalid condition type for if expression", condExpr->location);
+    llvm::Value *condBool = generateCondition(*condExpr->condition, "if expression");
+    if (!condBool)
       return nullptr;
-    }
 
     // Get the current function
     llvm::Function *func = builder->GetInsertBlock()->getParent();
 
     // Create blocks - they are automatically added to the function when created with a function
     // parameter
-    llvm::BasicBlock *thenBlock = llvm::BasicBlock::Create(context, "then", func);
-    llvm::BasicBlock *elseBlock = llvm::BasicBlock::Create(context, "else", func);
-    llvm::BasicBlock *mergeBlock = llvm::BasicBlock::Create(context, "ifcont", func);
+    llvm::BasicBlock *thenBlock = llvm::BasicBlock::Create(*context, "then", func);
+    llvm::BasicBlock *elseBlock = llvm::BasicBlock::Create(*context, "else", func);
+    llvm::BasicBlock *mergeBlock = llvm::BasicBlock::Create(*context, "ifcont", func);
 
     builder->CreateCondBr(condBool, thenBlock, elseBlock);
 
@@ -287,7 +640,7 @@ llvm::Value *CodeGenerator::generateExpression(const Expression &expr) {
     llvm::Value *thenValue = generateExpression(*condExpr->thenExpr);
     if (!thenValue)
       return nullptr;
-    builder->CreateBr(mergeBlock);
+    llvm::Instruction *thenBranch = builder->CreateBr(mergeBlock);
     thenBlock = builder->GetInsertBlock(); // Update in case of nested expr
 
     // Generate else block
@@ -295,9 +648,27 @@ llvm::Value *CodeGenerator::generateExpression(const Expression &expr) {
     llvm::Value *elseValue = generateExpression(*condExpr->elseExpr);
     if (!elseValue)
       return nullptr;
-    builder->CreateBr(mergeBlock);
+    llvm::Instruction *elseBranch = builder->CreateBr(mergeBlock);
     elseBlock = builder->GetInsertBlock(); // Update in case of nested expr
 
+    // A narrower branch value widens at the end of its own block
+    if (thenValue->getType() != elseValue->getType()) {
+      llvm::Type *thenType = thenValue->getType();
+      builder->SetInsertPoint(elseBranch);
+      elseValue = convertTo(elseValue, *condExpr->elseExpr, thenType);
+      if (elseValue->getType() != thenType) {
+        builder->SetInsertPoint(thenBranch);
+        thenValue = convertTo(thenValue, *condExpr->thenExpr, elseValue->getType());
+      }
+      if (thenValue->getType() != elseValue->getType()) {
+        reportError("Branches of if have different types: " +
+                        typeName(thenValue->getType(), *condExpr->thenExpr) + " and " +
+                        typeName(elseValue->getType(), *condExpr->elseExpr),
+                    condExpr->location);
+        return nullptr;
+      }
+    }
+
     // Generate merge block
     builder->SetInsertPoint(mergeBlock);
 
@@ -309,124 +680,1663 @@ llvm::Value *CodeGenerator::generateExpression(const Expression &expr) {
     return phi;
   }
 
+  if (const auto *arrayLit = dynamic_cast<const ArrayLiteral *>(&expr)) {
+    return generateArrayLiteral(*arrayLit);
+  }
+
+  if (const auto *indexExpr = dynamic_cast<const IndexExpression *>(&expr)) {
+    return generateIndex(*indexExpr);
+  }
+
+  if (const auto *recordLit = dynamic_cast<const RecordLiteral *>(&expr)) {
+    return generateRecordLiteral(*recordLit);
+  }
+
+  if (const auto *fieldAccess = dynamic_cast<const FieldAccess *>(&expr)) {
+    return generateFieldAccess(*fieldAccess);
+  }
+
+  if (const auto *letExpr = dynamic_cast<const LetExpression *>(&expr)) {
+    return generateLet(*letExpr);
+  }
+
+  if (const auto *matchExpr = dynamic_cast<const MatchExpression *>(&expr)) {
+    return generateMatch(*matchExpr);
+  }
+
   reportError("Unknown expression type", expr.location);
   return nullptr;
 }
 
-llvm::Function *CodeGenerator::generateFunction(const FunctionDef &func) {
-  llvm::Type *returnType = llvmType(*func.returnType);
+llvm::StructType *CodeGenerator::arrayType(llvm::Type *elementType) {
+  const std::string name = elementType->isFloatTy() ? "array.float" : "array.int";
+  if (llvm::StructType *existing = llvm::StructType::getTypeByName(*context, name)) {
+    return existing;
+  }
 
-  std::vector<llvm::Type *> paramTypes;
-  for (const auto &param : func.parameters) {
-    paramTypes.push_back(llvmType(*param.type));
+  llvm::StructType *type = llvm::StructType::create(
+      *context, {llvm::PointerType::get(elementType, 0), llvm::Type::getInt32Ty(*context)}, name);
+  arrayElements[type] = elementType;
+  return type;
+}
+
+llvm::Type *CodeGenerator::arrayElementType(const llvm::Type *type) const {
+  auto it = arrayElements.find(type);
+  return it != arrayElements.end() ? it->second : nullptr;
+}
+
+llvm::StructType *CodeGenerator::recordType(const std::vector<llvm::Type *> &fieldTypes,
+                                            const std::vector<std::string> &fieldNames) {
+  // Named by the source level type, so records with the same field types
+  // but different names stay apart and shards agree on the name
+  std::string name = fieldNames.empty() ? "(" : "{";
+  for (size_t i = 0; i < fieldTypes.size(); i++) {
+    name += i > 0 ? ", " : "";
+    name += fieldNames.empty() ? "" : fieldNames[i] + ": ";
+    name += typeName(fieldTypes[i]);
   }
+  name = (fieldNames.empty() ? "tuple" : "record") + name + (fieldNames.empty() ? ")" : "}");
 
-  llvm::FunctionType *funcType = llvm::FunctionType::get(returnType, paramTypes, false);
+  if (llvm::StructType *existing = llvm::StructType::getTypeByName(*context, name)) {
+    return existing;
+  }
 
-  llvm::Function *function =
-      llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, func.name, module.get());
+  llvm::StructType *type = llvm::StructType::create(*context, fieldTypes, name);
+  recordFields[type] = fieldNames;
+  return type;
+}
 
-  // Set arg names
-  unsigned idx = 0;
-  for (auto &arg : function->args()) {
-    arg.setName(func.parameters[idx++].name);
+const std::vector<std::string> *CodeGenerator::recordFieldNames(const llvm::Type *type) const {
+  auto it = recordFields.find(type);
+  return it != recordFields.end() ? &it->second : nullptr;
+}
+
+llvm::Value *CodeGenerator::generateRecordLiteral(const RecordLiteral &literal) {
+  std::vector<llvm::Value *> values;
+  std::vector<llvm::Type *> fieldTypes;
+  for (size_t i = 0; i < literal.fields.size(); i++) {
+    for (size_t j = 0; j < i && !literal.fieldNames.empty(); j++) {
+      if (literal.fieldNames[i] == literal.fieldNames[j]) {
+        reportError("Duplicate record field " + literal.fieldNames[i], literal.location);
+        return nullptr;
+      }
+    }
+
+    llvm::Value *value = generateExpression(*literal.fields[i]);
+    if (!value)
+      return nullptr;
+    values.push_back(value);
+    fieldTypes.push_back(value->getType());
   }
 
-  // Create block
-  llvm::BasicBlock *entry = llvm::BasicBlock::Create(context, "entry", function);
-  builder->SetInsertPoint(entry);
+  llvm::Value *record = llvm::PoisonValue::get(recordType(fieldTypes, literal.fieldNames));
+  for (unsigned i = 0; i < values.size(); i++) {
+    record = builder->CreateInsertValue(record, values[i], i, "record");
+  }
+  return record;
+}
 
-  currentFunction = function;
-  namedValues.clear();
+llvm::Value *CodeGenerator::generateFieldAccess(const FieldAccess &access) {
+  llvm::Value *record = generateExpression(*access.record);
+  if (!record)
+    return nullptr;
 
-  for (auto &arg : function->args()) {
-    namedValues[std::string(arg.getName())] = &arg;
+  const auto *fieldNames = recordFieldNames(record->getType());
+  if (!fieldNames) {
+    reportError("Only tuples and records have fields, not " + typeName(record->getType()),
+                access.location);
+    return nullptr;
   }
 
-  llvm::Value *retVal = generateExpression(*func.body);
-  if (retVal) {
-    builder->CreateRet(retVal);
+  // Tuple fields by position, record fields by name
+  const unsigned fieldCount = record->getType()->getStructNumElements();
+  unsigned index = fieldCount;
+  if (fieldNames->empty()) {
+    if (!access.field.empty() && std::isdigit(access.field[0]) && access.field.size() < 10) {
+      index = std::stoul(access.field);
+    }
+  } else {
+    for (unsigned i = 0; i < fieldCount; i++) {
+      if ((*fieldNames)[i] == access.field) {
+        index = i;
+      }
+    }
+  }
 
-    std::string errorString;
-    llvm::raw_string_ostream errorStream(errorString);
-    if (llvm::verifyFunction(*function, &errorStream)) {
-      std::cerr << "Function verification failed for " << func.name << ": " << errorString
-                << std::endl;
+  if (index >= fieldCount) {
+    reportError(typeName(record->getType()) + " has no field " + access.field, access.location);
+    return nullptr;
+  }
+  return builder->CreateExtractValue(record, index, access.field);
+}
+
+llvm::Value *CodeGenerator::generateLet(const LetExpression &let) {
+  llvm::Value *value = generateExpression(*let.value);
+  if (!value)
+    return nullptr;
+
+  // (a, b) = value binds the fields in order
+  std::vector<llvm::Value *> bound = {value};
+  if (let.destructure) {
+    const auto *fieldNames = recordFieldNames(value->getType());
+    if (!fieldNames || value->getType()->getStructNumElements() != let.names.size()) {
+      reportError("Can't bind " + std::to_string(let.names.size()) + " names to " +
+                      typeName(value->getType()),
+                  let.location);
+      return nullptr;
     }
 
-    functions[func.name] = function;
-    return function;
+    bound.clear();
+    for (unsigned i = 0; i < let.names.size(); i++) {
+      bound.push_back(builder->CreateExtractValue(value, i, let.names[i]));
+    }
   }
 
-  // Error occurred => rem func
-  function->eraseFromParent();
-  return nullptr;
+  // The names shadow parameters and outer lets within the body only
+  std::vector<std::pair<std::string, llvm::Value *>> shadowed;
+  for (size_t i = 0; i < let.names.size(); i++) {
+    auto it = namedValues.find(let.names[i]);
+    shadowed.emplace_back(let.names[i], it != namedValues.end() ? it->second : nullptr);
+  }
+  for (size_t i = 0; i < let.names.size(); i++) {
+    namedValues[let.names[i]] = bound[i];
+  }
+
+  llvm::Value *result = generateExpression(*let.body);
+
+  for (auto it = shadowed.rbegin(); it != shadowed.rend(); ++it) {
+    if (it->second) {
+      namedValues[it->first] = it->second;
+    } else {
+      namedValues.erase(it->first);
+    }
+  }
+  return result;
 }
 
-void CodeGenerator::declareBuiltinFunctions() {
-  // str_print function: (str) -> int
-  declareBuiltinFunction("str_print", llvm::Type::getInt32Ty(context),
-                         {llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0)});
+llvm::Value *CodeGenerator::generateMatch(const MatchExpression &match) {
+  llvm::Value *subject = generateExpression(*match.subject);
+  if (!subject)
+    return nullptr;
 
-  // str_read function: (int) -> str
-  declareBuiltinFunction("str_read", llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0),
-                         {llvm::Type::getInt32Ty(context)});
+  llvm::Type *subjectType = subject->getType();
+  if (!subjectType->isPointerTy() && (!subjectType->isIntegerTy() || subjectType->isIntegerTy(1))) {
+    reportError("Can only match on integers, chars and str, not " + typeName(subjectType),
+                match.location);
+    return nullptr;
+  }
 
-  // str_len function: (str) -> int
-  declareBuiltinFunction("str_len", llvm::Type::getInt32Ty(context),
-                         {llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0)});
+  llvm::Function *func = builder->GetInsertBlock()->getParent();
+  std::vector<llvm::BasicBlock *> armBlocks;
+  for (const auto &arm : match.arms) {
+    const char *name = arm.patterns.empty() ? "matchdefault" : "matcharm";
+    armBlocks.push_back(llvm::BasicBlock::Create(*context, name, func));
+  }
+  llvm::BasicBlock *mergeBlock = llvm::BasicBlock::Create(*context, "matchcont", func);
 
-  // str_at function: (str, int) -> char
-  declareBuiltinFunction(
-      "str_at", llvm::Type::getInt8Ty(context),
-      {llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0), llvm::Type::getInt32Ty(context)});
+  if (subjectType->isPointerTy()) {
+    if (!dispatchString(subject, match, armBlocks))
+      return nullptr;
+  } else {
+    const unsigned bits = subjectType->getIntegerBitWidth();
+    llvm::SwitchInst *dispatch = builder->CreateSwitch(subject, armBlocks.back());
+    std::unordered_set<int64_t> seen;
+
+    for (size_t i = 0; i < match.arms.size(); i++) {
+      for (const auto &pattern : match.arms[i].patterns) {
+        const auto literal = integerLiteral(*pattern);
+        if (!literal) {
+          reportError("String patterns can't match " + typeName(subjectType), pattern->location);
+          return nullptr;
+        }
+        if (!llvm::isIntN(bits, *literal)) {
+          reportError("Pattern " + std::to_string(*literal) + " doesn't fit in " +
+                          typeName(subjectType, *match.subject),
+                      pattern->location);
+          return nullptr;
+        }
+        if (!seen.insert(*literal).second) {
+          reportError("Duplicate match pattern " + std::to_string(*literal), pattern->location);
+          return nullptr;
+        }
+        dispatch->addCase(llvm::ConstantInt::get(llvm::cast<llvm::IntegerType>(subjectType),
+                                                 *literal, true),
+                          armBlocks[i]);
+      }
+    }
+  }
 
-  // str_sub function: (str, int, int) -> str
-  declareBuiltinFunction("str_sub", llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0),
-                         {llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0),
-                          llvm::Type::getInt32Ty(context), llvm::Type::getInt32Ty(context)});
+  std::vector<llvm::Value *> values;
+  std::vector<llvm::Instruction *> branches;
+  std::vector<llvm::BasicBlock *> endBlocks;
+  for (size_t i = 0; i < match.arms.size(); i++) {
+    builder->SetInsertPoint(armBlocks[i]);
+    llvm::Value *value = generateExpression(*match.arms[i].body);
+    if (!value)
+      return nullptr;
+    values.push_back(value);
+    branches.push_back(builder->CreateBr(mergeBlock));
+    endBlocks.push_back(builder->GetInsertBlock()); // Update in case of nested expr
+  }
 
-  // str_find function: (str, str) -> int
-  declareBuiltinFunction("str_find", llvm::Type::getInt32Ty(context),
-                         {llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0),
-                          llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0)});
+  // Narrower arm values widen at the end of their own block, to the first
+  // arm's type or, if that doesn't work, the earlier arms to this one's
+  llvm::Type *resultType = values.front()->getType();
+  for (size_t i = 1; i < values.size(); i++) {
+    if (values[i]->getType() == resultType)
+      continue;
+
+    builder->SetInsertPoint(branches[i]);
+    llvm::Value *converted = convertTo(values[i], *match.arms[i].body, resultType);
+    if (converted->getType() == resultType) {
+      values[i] = converted;
+      continue;
+    }
 
-  // int_to_str function: (int) -> str
-  declareBuiltinFunction("int_to_str", llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0),
-                         {llvm::Type::getInt32Ty(context)});
+    llvm::Type *armType = values[i]->getType();
+    for (size_t j = 0; j < i; j++) {
+      builder->SetInsertPoint(branches[j]);
+      values[j] = convertTo(values[j], *match.arms[j].body, armType);
+      if (values[j]->getType() != armType) {
+        reportError("Arms of match have different types: " +
+                        typeName(resultType, *match.arms[j].body) + " and " +
+                        typeName(armType, *match.arms[i].body),
+                    match.arms[i].location);
+        return nullptr;
+      }
+    }
+    resultType = armType;
+  }
 
-  // str_to_int function: (str) -> int
-  declareBuiltinFunction("str_to_int", llvm::Type::getInt32Ty(context),
-                         {llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0)});
+  builder->SetInsertPoint(mergeBlock);
+  llvm::PHINode *phi = builder->CreatePHI(resultType, values.size(), "matchtmp");
+  for (size_t i = 0; i < values.size(); i++) {
+    phi->addIncoming(values[i], endBlocks[i]);
+  }
+  return phi;
+}
 
-  // float_to_str function: (float) -> str
-  declareBuiltinFunction("float_to_str", llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0),
-                         {llvm::Type::getFloatTy(context)});
+bool CodeGenerator::dispatchString(llvm::Value *subject, const MatchExpression &match,
+                                   const std::vector<llvm::BasicBlock *> &armBlocks) {
+  // Patterns by length, compared in source order within a length
+  std::map<size_t, std::vector<std::pair<std::string, llvm::BasicBlock *>>> byLength;
+  std::unordered_set<std::string> seen;
+  for (size_t i = 0; i < match.arms.size(); i++) {
+    for (const auto &pattern : match.arms[i].patterns) {
+      const auto *strLit = dynamic_cast<const StringLiteral *>(pattern.get());
+      if (!strLit) {
+        reportError("Integer patterns can't match str", pattern->location);
+        return false;
+      }
 
-  // str_to_float function: (str) -> float
-  declareBuiltinFunction("str_to_float", llvm::Type::getFloatTy(context),
-                         {llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0)});
+      // The subject can't contain a NUL, neither does the interned pattern
+      const std::string text = strLit->value.substr(0, strLit->value.find('\0'));
+      if (!seen.insert(text).second) {
+        reportError("Duplicate match pattern \"" + text + "\"", pattern->location);
+        return false;
+      }
+      byLength[text.size()].emplace_back(text, armBlocks[i]);
+    }
+  }
 
-  // str_cmp function: (str, str) -> int
-  declareBuiltinFunction("str_cmp", llvm::Type::getInt32Ty(context),
-                         {llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0),
-                          llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0)});
+  // strnlen stops one past the longest pattern, longer subjects can't match
+  llvm::Type *sizeType = builder->getIntPtrTy(module->getDataLayout());
+  llvm::Type *strType = llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0);
+  const size_t maxLength = byLength.empty() ? 0 : byLength.rbegin()->first;
+
+  llvm::Value *length = nullptr;
+  if (const auto known = literalLength(subject)) {
+    length = llvm::ConstantInt::get(sizeType, *known);
+  } else {
+    llvm::FunctionCallee strnlenFunc =
+        module->getOrInsertFunction("strnlen", sizeType, strType, sizeType);
+    length = builder->CreateCall(
+        strnlenFunc, {subject, llvm::ConstantInt::get(sizeType, maxLength + 1)}, "matchlen");
+  }
+
+  llvm::Function *func = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *defaultBlock = armBlocks.back();
+  llvm::SwitchInst *dispatch = builder->CreateSwitch(length, defaultBlock, byLength.size());
+
+  // Fixed length memcmp calls are expanded into a few wide loads
+  llvm::FunctionCallee memcmpFunc = module->getOrInsertFunction(
+      "memcmp", llvm::Type::getInt32Ty(*context), strType, strType, sizeType);
+
+  for (const auto &[patternLength, candidates] : byLength) {
+    llvm::BasicBlock *compareBlock = llvm::BasicBlock::Create(*context, "matchlen", func);
+    dispatch->addCase(
+        llvm::cast<llvm::ConstantInt>(llvm::ConstantInt::get(sizeType, patternLength)),
+        compareBlock);
+    builder->SetInsertPoint(compareBlock);
+
+    // Only one pattern can be empty
+    if (patternLength == 0) {
+      builder->CreateBr(candidates.front().second);
+      continue;
+    }
+
+    for (size_t j = 0; j < candidates.size(); j++) {
+      llvm::Value *result = builder->CreateCall(
+          memcmpFunc,
+          {subject, internString(candidates[j].first),
+           llvm::ConstantInt::get(sizeType, patternLength)},
+          "memcmptmp");
+      llvm::Value *equal =
+          builder->CreateICmpEQ(result, llvm::ConstantInt::get(result->getType(), 0), "matcheq");
+
+      llvm::BasicBlock *next = j + 1 < candidates.size()
+                                   ? llvm::BasicBlock::Create(*context, "matchcmp", func)
+                                   : defaultBlock;
+      builder->CreateCondBr(equal, candidates[j].second, next);
+      builder->SetInsertPoint(next);
+    }
+  }
+  return true;
 }
 
-llvm::Function *CodeGenerator::declareBuiltinFunction(const std::string &name,
-                                                      llvm::Type *returnType,
-                                                      const std::vector<llvm::Type *> &paramTypes) {
-  llvm::FunctionType *funcType = llvm::FunctionType::get(returnType, paramTypes, false);
-  auto *func =
-      llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, name, module.get());
-  func->setCallingConv(llvm::CallingConv::C);
+llvm::Value *CodeGenerator::allocateArray(llvm::Type *elementType, llvm::Value *length) {
+  llvm::Type *sizeType = builder->getIntPtrTy(module->getDataLayout());
 
-  return func;
+  // Negative lengths give empty arrays
+  llvm::Value *zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
+  length = builder->CreateSelect(builder->CreateICmpSLT(length, zero), zero, length, "length");
+
+  const uint64_t elementSize = module->getDataLayout().getTypeAllocSize(elementType);
+  llvm::Value *bytes =
+      builder->CreateMul(builder->CreateZExt(length, sizeType),
+                         llvm::ConstantInt::get(sizeType, elementSize), "bytes", true, true);
+
+  // Storage lives in the runtime's arena, like the strings builtins return
+  llvm::FunctionCallee allocFunc = module->getOrInsertFunction(
+      "lge_alloc", llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0), sizeType);
+
+  // Fresh memory, so loops writing a new array never alias their inputs
+  if (auto *allocDecl = llvm::dyn_cast<llvm::Function>(allocFunc.getCallee())) {
+    allocDecl->setReturnDoesNotAlias();
+    allocDecl->setDoesNotThrow();
+  }
+  llvm::Value *data = builder->CreateCall(allocFunc, {bytes}, "arraydata");
+  data = builder->CreateBitCast(data, llvm::PointerType::get(elementType, 0));
+
+  llvm::Value *array = llvm::PoisonValue::get(arrayType(elementType));
+  array = builder->CreateInsertValue(array, data, 0);
+  return builder->CreateInsertValue(array, length, 1, "array");
+}
+
+llvm::Value *CodeGenerator::generateArrayLiteral(const ArrayLiteral &literal) {
+  // Without elements there's nothing to take the type from
+  if (literal.elements.empty()) {
+    reportError("Empty array literal, use array_int(0, 0) or array_float(0, 0.0)",
+                literal.location);
+    return nullptr;
+  }
+
+  std::vector<llvm::Value *> values;
+  for (const auto &element : literal.elements) {
+    llvm::Value *value = generateExpression(*element);
+    if (!value)
+      return nullptr;
+    if (!values.empty() && value->getType() != values.front()->getType()) {
+      reportError("Array elements must have the same type", element->location);
+      return nullptr;
+    }
+    values.push_back(value);
+  }
+
+  llvm::Type *elementType = values.front()->getType();
+  if (!elementType->isIntegerTy(32) && !elementType->isFloatTy()) {
+    reportError("Arrays can only hold int or float", literal.location);
+    return nullptr;
+  }
+
+  llvm::Value *array = allocateArray(
+      elementType, llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), values.size()));
+  llvm::Value *data = builder->CreateExtractValue(array, 0, "data");
+  for (size_t i = 0; i < values.size(); i++) {
+    llvm::Value *elementPtr = builder->CreateConstInBoundsGEP1_64(elementType, data, i);
+    builder->CreateStore(values[i], elementPtr);
+  }
+
+  return array;
+}
+
+llvm::Value *CodeGenerator::generateIndex(const IndexExpression &indexExpr) {
+  llvm::Value *array = generateExpression(*indexExpr.array);
+  llvm::Value *index = generateExpression(*indexExpr.index);
+  if (!array || !index)
+    return nullptr;
+
+  llvm::Type *elementType = arrayElementType(array->getType());
+  if (!elementType) {
+    reportError("Only arrays can be indexed", indexExpr.location);
+    return nullptr;
+  }
+  // Narrower integers and chars widen like anywhere else
+  index = convertTo(index, *indexExpr.index, llvm::Type::getInt32Ty(*context));
+  if (!index->getType()->isIntegerTy(32)) {
+    reportError("Array index must be an int, not " + typeName(index->getType(), *indexExpr.index),
+                indexExpr.index->location);
+    return nullptr;
+  }
+
+  llvm::Value *data = builder->CreateExtractValue(array, 0, "data");
+  llvm::Value *length = builder->CreateExtractValue(array, 1, "len");
+
+  // Unsigned compare rejects negative indices along with ones past the end
+  llvm::Value *inBounds = builder->CreateICmpULT(index, length, "inbounds");
+
+  llvm::Function *func = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *checkBlock = builder->GetInsertBlock();
+  llvm::BasicBlock *loadBlock = llvm::BasicBlock::Create(*context, "index.load", func);
+  llvm::BasicBlock *mergeBlock = llvm::BasicBlock::Create(*context, "index.cont", func);
+
+  builder->CreateCondBr(inBounds, loadBlock, mergeBlock);
+
+  builder->SetInsertPoint(loadBlock);
+  llvm::Value *elementPtr = builder->CreateInBoundsGEP(elementType, data, index, "elementptr");
+  llvm::Value *element = builder->CreateLoad(elementType, elementPtr, "element");
+  builder->CreateBr(mergeBlock);
+
+  builder->SetInsertPoint(mergeBlock);
+  llvm::PHINode *phi = builder->CreatePHI(elementType, 2, "index");
+  phi->addIncoming(llvm::Constant::getNullValue(elementType), checkBlock);
+  phi->addIncoming(element, loadBlock);
+
+  return phi;
+}
+
+llvm::Value *CodeGenerator::generateArrayBuiltin(const FunctionCall &call) {
+  // These take a function name first, not a value
+  if (call.funcName == "map" || call.funcName == "fold" || call.funcName == "zip_with" ||
+      call.funcName.starts_with("par_")) {
+    return generateArrayIteration(call);
+  }
+
+  std::vector<llvm::Value *> args;
+  for (const auto &arg : call.args) {
+    llvm::Value *argValue = generateExpression(*arg);
+    if (!argValue)
+      return nullptr;
+    args.push_back(argValue);
+  }
+
+  const size_t expectedArgs = call.funcName == "len" || call.funcName == "sum" ? 1 : 2;
+  if (args.size() != expectedArgs) {
+    reportError("Incorrect number of arguments for function: " + call.funcName, call.location);
+    return nullptr;
+  }
+
+  llvm::Type *intType = llvm::Type::getInt32Ty(*context);
+
+  // len(array) -> int
+  if (call.funcName == "len") {
+    if (!arrayElementType(args[0]->getType())) {
+      reportError("len expects an array", call.location);
+      return nullptr;
+    }
+    return builder->CreateExtractValue(args[0], 1, "len");
+  }
+
+  // sum(array) -> int or float
+  if (call.funcName == "sum") {
+    llvm::Type *elementType = arrayElementType(args[0]->getType());
+    if (!elementType) {
+      reportError("sum expects an array", call.location);
+      return nullptr;
+    }
+
+    llvm::Value *data = builder->CreateExtractValue(args[0], 0, "data");
+    return generateLoop(
+        builder->CreateExtractValue(args[0], 1, "len"), llvm::Constant::getNullValue(elementType),
+        [&](llvm::Value *i, llvm::Value *acc) -> llvm::Value * {
+          llvm::Value *element = builder->CreateLoad(
+              elementType, builder->CreateInBoundsGEP(elementType, data, i, "elementptr"),
+              "element");
+          if (elementType->isIntegerTy()) {
+            return builder->CreateAdd(acc, element, "sumtmp");
+          }
+
+          // Reassociation lets the vectorizer keep partial sums per lane
+          llvm::Value *result = builder->CreateFAdd(acc, element, "fsumtmp");
+          if (auto *inst = llvm::dyn_cast<llvm::Instruction>(result)) {
+            inst->setHasAllowReassoc(true);
+          }
+          return result;
+        });
+  }
+
+  // array_range(start, end) -> [int], start ... end - 1
+  if (call.funcName == "array_range") {
+    if (args[0]->getType() != intType || args[1]->getType() != intType) {
+      reportError("array_range expects (int, int)", call.location);
+      return nullptr;
+    }
+
+    llvm::Value *array = allocateArray(intType, builder->CreateSub(args[1], args[0], "rangelen"));
+    llvm::Value *data = builder->CreateExtractValue(array, 0, "data");
+    generateLoop(builder->CreateExtractValue(array, 1, "len"), nullptr,
+                 [&](llvm::Value *i, llvm::Value *) {
+                   builder->CreateStore(builder->CreateAdd(args[0], i, "rangetmp"),
+                                        builder->CreateInBoundsGEP(intType, data, i, "elementptr"));
+                   return nullptr;
+                 });
+    return array;
+  }
+
+  // array_int(n, value) -> [int], array_float(n, value) -> [float]
+  llvm::Type *elementType =
+      call.funcName == "array_int" ? intType : llvm::Type::getFloatTy(*context);
+  if (args[0]->getType() != intType || args[1]->getType() != elementType) {
+    const std::string valueType = elementType == intType ? "int" : "float";
+    reportError(call.funcName + " expects (int, " + valueType + ")", call.location);
+    return nullptr;
+  }
+
+  llvm::Value *array = allocateArray(elementType, args[0]);
+  llvm::Value *data = builder->CreateExtractValue(array, 0, "data");
+  generateLoop(builder->CreateExtractValue(array, 1, "len"), nullptr,
+               [&](llvm::Value *i, llvm::Value *) {
+                 llvm::Value *ptr = builder->CreateInBoundsGEP(elementType, data, i, "elementptr");
+                 builder->CreateStore(args[1], ptr);
+                 return nullptr;
+               });
+  return array;
+}
+
+llvm::Value *CodeGenerator::generateArrayIteration(const FunctionCall &call) {
+  const size_t expectedArgs = call.funcName == "map" || call.funcName == "par_map" ? 2 : 3;
+  if (call.args.size() != expectedArgs) {
+    reportError("Incorrect number of arguments for function: " + call.funcName, call.location);
+    return nullptr;
+  }
+
+  // Function values are untyped pointers, only a named function says what
+  // it takes and returns
+  const auto *funcName = dynamic_cast<const Identifier *>(call.args[0].get());
+  llvm::Function *callee = funcName && !namedValues.contains(funcName->name)
+                               ? lookupFunction(funcName->name)
+                               : nullptr;
+  if (!callee) {
+    reportError(call.funcName + " expects the name of a function first", call.args[0]->location);
+    return nullptr;
+  }
+
+  std::vector<llvm::Value *> args;
+  for (size_t i = 1; i < call.args.size(); i++) {
+    llvm::Value *argValue = generateExpression(*call.args[i]);
+    if (!argValue)
+      return nullptr;
+    args.push_back(argValue);
+  }
+
+  // fold(f, init, xs) passes the accumulator first
+  const bool isParallel = call.funcName.starts_with("par_");
+  const bool isFold = call.funcName == "fold" || call.funcName == "par_reduce";
+  std::vector<llvm::Value *> arrays(args.begin() + (isFold ? 1 : 0), args.end());
+
+  std::vector<llvm::Type *> calleeParams;
+  if (isFold) {
+    calleeParams.push_back(args[0]->getType());
+  }
+  for (auto *array : arrays) {
+    llvm::Type *elementType = arrayElementType(array->getType());
+    if (!elementType) {
+      reportError(call.funcName + " expects an array", call.location);
+      return nullptr;
+    }
+    calleeParams.push_back(elementType);
+  }
+
+  // par_reduce combines partial results with f as well, so f takes two of
+  // the element type
+  llvm::FunctionType *calleeType = callee->getFunctionType();
+  llvm::Type *resultType = calleeType->getReturnType();
+  if (calleeType->params() != llvm::ArrayRef<llvm::Type *>(calleeParams) ||
+      (isFold ? resultType != args[0]->getType()
+              : !resultType->isIntegerTy(32) && !resultType->isFloatTy()) ||
+      (isFold && isParallel && calleeParams[0] != calleeParams[1])) {
+    reportError("Function " + funcName->name + " has the wrong type for " + call.funcName,
+                call.args[0]->location);
+    return nullptr;
+  }
+
+  // Calls from other threads may only happen without observable effects
+  if (isParallel && !purity->isPure(funcName->name)) {
+    reportError("Function " + funcName->name + " has side effects, " + call.funcName +
+                    " needs a pure function",
+                call.args[0]->location);
+    return nullptr;
+  }
+
+  // zip_with stops at the end of the shorter array
+  std::vector<llvm::Value *> data;
+  llvm::Value *count = nullptr;
+  for (auto *array : arrays) {
+    data.push_back(builder->CreateExtractValue(array, 0, "data"));
+    llvm::Value *length = builder->CreateExtractValue(array, 1, "len");
+    count = count ? builder->CreateSelect(builder->CreateICmpSLT(length, count), length, count,
+                                          "count")
+                  : length;
+  }
+
+  // Element i of every array, after the accumulator for fold
+  auto callAt = [&](const std::vector<llvm::Value *> &arrayData, llvm::Value *i,
+                    llvm::Value *acc) {
+    std::vector<llvm::Value *> callArgs;
+    if (acc) {
+      callArgs.push_back(acc);
+    }
+    for (auto *elements : arrayData) {
+      llvm::Type *elementType = calleeParams[callArgs.size()];
+      callArgs.push_back(builder->CreateLoad(
+          elementType, builder->CreateInBoundsGEP(elementType, elements, i, "elementptr"),
+          "element"));
+    }
+
+    // Inlined into the loop the body can be vectorized
+    llvm::CallInst *result = builder->CreateCall(callee, callArgs, "calltmp");
+    result->addFnAttr(llvm::Attribute::AlwaysInline);
+    return result;
+  };
+
+  // par_reduce folds fixed blocks in parallel, then the blocks' results in
+  // order, the same for any number of threads
+  if (isFold && isParallel) {
+    llvm::Type *intType = llvm::Type::getInt32Ty(*context);
+    llvm::Value *one = llvm::ConstantInt::get(intType, 1);
+    llvm::Value *blocks = llvm::ConstantInt::get(intType, reduceBlocks);
+    llvm::Value *blockSize =
+        builder->CreateAdd(builder->CreateSDiv(count, blocks), one, "blocksize");
+    llvm::Value *blockCount = builder->CreateSDiv(
+        builder->CreateAdd(count, builder->CreateSub(blockSize, one)), blockSize, "blocks");
+    llvm::Value *partials =
+        builder->CreateExtractValue(allocateArray(resultType, blockCount), 0, "partials");
+
+    generateParallelFor(
+        blockCount, {data[0], partials, count, blockSize, args[0]},
+        [&](const std::vector<llvm::Value *> &captured, llvm::Value *block) {
+          llvm::Value *begin = builder->CreateMul(block, captured[3], "begin", true, true);
+          llvm::Value *end = builder->CreateAdd(begin, captured[3], "end", true, true);
+          end = builder->CreateSelect(builder->CreateICmpSLT(end, captured[2]), end, captured[2]);
+
+          llvm::Value *acc = generateLoop(
+              builder->CreateSub(end, begin, "blocklen"), captured[4],
+              [&](llvm::Value *i, llvm::Value *acc) -> llvm::Value * {
+                return callAt({captured[0]}, builder->CreateAdd(begin, i, "index", true, true),
+                              acc);
+              });
+          llvm::Value *partial =
+              builder->CreateInBoundsGEP(resultType, captured[1], block, "partial");
+          builder->CreateStore(acc, partial);
+        });
+
+    return generateLoop(blockCount, args[0],
+                        [&](llvm::Value *i, llvm::Value *acc) -> llvm::Value * {
+                          return callAt({partials}, i, acc);
+                        });
+  }
+
+  if (isFold) {
+    return generateLoop(count, args[0], [&](llvm::Value *i, llvm::Value *acc) -> llvm::Value * {
+      return callAt(data, i, acc);
+    });
+  }
+
+  llvm::Value *result = allocateArray(resultType, count);
+  llvm::Value *resultData = builder->CreateExtractValue(result, 0, "data");
+  if (isParallel) {
+    generateParallelFor(count, {data[0], resultData},
+                        [&](const std::vector<llvm::Value *> &captured, llvm::Value *i) {
+                          builder->CreateStore(
+                              callAt({captured[0]}, i, nullptr),
+                              builder->CreateInBoundsGEP(resultType, captured[1], i, "elementptr"));
+                        });
+    return result;
+  }
+
+  generateLoop(count, nullptr, [&](llvm::Value *i, llvm::Value *) {
+    builder->CreateStore(callAt(data, i, nullptr),
+                         builder->CreateInBoundsGEP(resultType, resultData, i, "elementptr"));
+    return nullptr;
+  });
+  return result;
+}
+
+void CodeGenerator::generateParallelFor(
+    llvm::Value *count, const std::vector<llvm::Value *> &captures,
+    const std::function<void(const std::vector<llvm::Value *> &, llvm::Value *)> &body) {
+  llvm::Type *intType = llvm::Type::getInt32Ty(*context);
+  llvm::Type *bytePtrType = llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0);
+
+  std::vector<llvm::Type *> captureTypes;
+  for (auto *value : captures) {
+    captureTypes.push_back(value->getType());
+  }
+  llvm::StructType *envType = llvm::StructType::get(*context, captureTypes);
+
+  llvm::FunctionType *bodyType = llvm::FunctionType::get(
+      llvm::Type::getVoidTy(*context), {bytePtrType, intType, intType}, false);
+  llvm::Function *bodyFunc = llvm::Function::Create(bodyType, llvm::Function::InternalLinkage,
+                                                    "parallel.body", module.get());
+  bodyFunc->addParamAttr(0, llvm::Attribute::NoAlias);
+
+  {
+    // body(env, begin, end) runs the iterations begin ... end - 1
+    llvm::IRBuilderBase::InsertPointGuard guard(*builder);
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", bodyFunc));
+
+    llvm::Value *env =
+        builder->CreateBitCast(bodyFunc->getArg(0), llvm::PointerType::get(envType, 0), "env");
+    llvm::Value *begin = bodyFunc->getArg(1);
+    llvm::Value *end = bodyFunc->getArg(2);
+
+    std::vector<llvm::Value *> captured;
+    for (unsigned i = 0; i < captureTypes.size(); i++) {
+      captured.push_back(builder->CreateLoad(
+          captureTypes[i], builder->CreateStructGEP(envType, env, i), "captured"));
+    }
+
+    generateLoop(builder->CreateSub(end, begin, "count"), nullptr,
+                 [&](llvm::Value *i, llvm::Value *) {
+                   body(captured, builder->CreateAdd(begin, i, "index", true, true));
+                   return nullptr;
+                 });
+    builder->CreateRetVoid();
+  }
+
+  // The captured values live in the caller's frame until the loop is done
+  llvm::Function *func = builder->GetInsertBlock()->getParent();
+  llvm::IRBuilder<> entryBuilder(&func->getEntryBlock(), func->getEntryBlock().begin());
+  llvm::Value *env = entryBuilder.CreateAlloca(envType, nullptr, "env");
+  for (unsigned i = 0; i < captures.size(); i++) {
+    builder->CreateStore(captures[i], builder->CreateStructGEP(envType, env, i));
+  }
+
+  llvm::FunctionCallee parallelFor = module->getOrInsertFunction(
+      "lge_parallel_for", llvm::Type::getVoidTy(*context), intType,
+      llvm::PointerType::get(bodyType, 0), bytePtrType);
+  builder->CreateCall(parallelFor, {count, bodyFunc, builder->CreateBitCast(env, bytePtrType)});
+}
+
+const FunctionCall *CodeGenerator::spawnableOperand(const BinaryOp &binOp) {
+  if (!options.autoParallel)
+    return nullptr;
+
+  const auto *call = dynamic_cast<const FunctionCall *>(binOp.left.get());
+  if (!call || namedValues.contains(call->funcName) || !purity->isPure(call->funcName))
+    return nullptr;
+
+  // The result comes back through the task's environment, memory the task
+  // allocated is gone by then
+  llvm::Function *callee = lookupFunction(call->funcName);
+  if (!callee || callee->arg_size() != call->args.size())
+    return nullptr;
+  llvm::Type *resultType = callee->getReturnType();
+  if (!resultType->isIntegerTy() && !resultType->isFloatingPointTy())
+    return nullptr;
+
+  if (costModel->cost(*call) < spawnThreshold || costModel->cost(*binOp.right) < spawnThreshold)
+    return nullptr;
+  return call;
+}
+
+std::optional<CodeGenerator::SpawnedTask> CodeGenerator::spawnCall(const FunctionCall &call) {
+  llvm::Function *callee = lookupFunction(call.funcName);
+
+  std::vector<llvm::Value *> args;
+  for (const auto &arg : call.args) {
+    llvm::Value *argValue = generateExpression(*arg);
+    if (!argValue)
+      return std::nullopt;
+    args.push_back(convertTo(argValue, *arg, callee->getArg(args.size())->getType()));
+  }
+
+  std::vector<llvm::Type *> fieldTypes;
+  for (auto *arg : args) {
+    fieldTypes.push_back(arg->getType());
+  }
+  if (callee->getFunctionType()->params() != llvm::ArrayRef<llvm::Type *>(fieldTypes)) {
+    reportError("Invalid arguments for function: " + call.funcName, call.location);
+    return std::nullopt;
+  }
+  fieldTypes.push_back(callee->getReturnType());
+  llvm::StructType *envType = llvm::StructType::get(*context, fieldTypes);
+
+  // task(env) calls the function with the stored arguments and stores the result
+  llvm::Type *bytePtrType = llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0);
+  llvm::FunctionType *taskType =
+      llvm::FunctionType::get(llvm::Type::getVoidTy(*context), {bytePtrType}, false);
+  llvm::Function *taskFunc =
+      llvm::Function::Create(taskType, llvm::Function::InternalLinkage, "task", module.get());
+  taskFunc->addParamAttr(0, llvm::Attribute::NoAlias);
+
+  {
+    llvm::IRBuilderBase::InsertPointGuard guard(*builder);
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", taskFunc));
+
+    llvm::Value *env =
+        builder->CreateBitCast(taskFunc->getArg(0), llvm::PointerType::get(envType, 0), "env");
+    std::vector<llvm::Value *> taskArgs;
+    for (unsigned i = 0; i < args.size(); i++) {
+      taskArgs.push_back(
+          builder->CreateLoad(fieldTypes[i], builder->CreateStructGEP(envType, env, i), "arg"));
+    }
+
+    llvm::Value *result = builder->CreateCall(callee, taskArgs, "calltmp");
+    builder->CreateStore(result, builder->CreateStructGEP(envType, env, args.size()));
+    builder->CreateRetVoid();
+  }
+
+  llvm::Function *func = builder->GetInsertBlock()->getParent();
+  llvm::IRBuilder<> entryBuilder(&func->getEntryBlock(), func->getEntryBlock().begin());
+  llvm::Value *env = entryBuilder.CreateAlloca(envType, nullptr, "taskenv");
+  for (unsigned i = 0; i < args.size(); i++) {
+    builder->CreateStore(args[i], builder->CreateStructGEP(envType, env, i));
+  }
+
+  llvm::FunctionCallee spawnFunc =
+      module->getOrInsertFunction("lge_task_spawn", bytePtrType,
+                                  llvm::PointerType::get(taskType, 0), bytePtrType);
+  llvm::Value *handle =
+      builder->CreateCall(spawnFunc, {taskFunc, builder->CreateBitCast(env, bytePtrType)}, "task");
+  return SpawnedTask{envType, env, handle};
+}
+
+llvm::Value *CodeGenerator::joinTask(const SpawnedTask &task) {
+  llvm::Type *bytePtrType = llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0);
+  llvm::FunctionCallee waitFunc = module->getOrInsertFunction(
+      "lge_task_wait", llvm::Type::getVoidTy(*context), bytePtrType);
+  builder->CreateCall(waitFunc, {task.handle});
+
+  const unsigned resultIndex = task.envType->getNumElements() - 1;
+  return builder->CreateLoad(task.envType->getElementType(resultIndex),
+                             builder->CreateStructGEP(task.envType, task.env, resultIndex),
+                             "taskresult");
+}
+
+llvm::Value *CodeGenerator::generateLoop(
+    llvm::Value *count, llvm::Value *initial,
+    const std::function<llvm::Value *(llvm::Value *, llvm::Value *)> &body) {
+  llvm::Function *func = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *entryBlock = builder->GetInsertBlock();
+  llvm::BasicBlock *loopBlock = llvm::BasicBlock::Create(*context, "loop", func);
+  llvm::BasicBlock *exitBlock = llvm::BasicBlock::Create(*context, "loop.end", func);
+
+  llvm::Value *zero = llvm::ConstantInt::get(count->getType(), 0);
+  builder->CreateCondBr(builder->CreateICmpSGT(count, zero, "loop.any"), loopBlock, exitBlock);
+
+  builder->SetInsertPoint(loopBlock);
+  llvm::PHINode *index = builder->CreatePHI(count->getType(), 2, "i");
+  index->addIncoming(zero, entryBlock);
+
+  llvm::PHINode *acc = nullptr;
+  if (initial) {
+    acc = builder->CreatePHI(initial->getType(), 2, "acc");
+    acc->addIncoming(initial, entryBlock);
+  }
+
+  llvm::Value *nextAcc = body(index, acc);
+
+  llvm::Value *next =
+      builder->CreateAdd(index, llvm::ConstantInt::get(count->getType(), 1), "i.next", true, true);
+  llvm::BasicBlock *latchBlock = builder->GetInsertBlock();
+  index->addIncoming(next, latchBlock);
+  if (acc) {
+    acc->addIncoming(nextAcc, latchBlock);
+  }
+  builder->CreateCondBr(builder->CreateICmpSLT(next, count, "loop.cond"), loopBlock, exitBlock);
+
+  builder->SetInsertPoint(exitBlock);
+  if (!acc)
+    return nullptr;
+
+  llvm::PHINode *result = builder->CreatePHI(initial->getType(), 2, "acc.end");
+  result->addIncoming(initial, entryBlock);
+  result->addIncoming(nextAcc, latchBlock);
+  return result;
+}
+
+llvm::Value *CodeGenerator::lowerBuiltinCall(const FunctionCall &call,
+                                             const std::vector<llvm::Value *> &args) {
+  const auto lhsLength = literalLength(args[0]);
+
+  if (call.funcName == "str_len") {
+    // Length of a literal is known at compile time
+    if (lhsLength) {
+      return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), *lhsLength);
+    }
+    return nullptr;
+  }
+
+  if (call.funcName == "str_at") {
+    return generateStrAt(args[0], args[1], lhsLength);
+  }
+
+  if (call.funcName == "str_cmp") {
+    // Literals are interned, so two of them are equal iff they are the same global
+    const auto rhsLength = literalLength(args[1]);
+    if (lhsLength && rhsLength) {
+      return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), args[0] == args[1]);
+    }
+
+    // Against a literal, strcmp is a libcall LLVM can turn into memcmp/loads
+    if (lhsLength || rhsLength) {
+      llvm::Type *strType = llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0);
+      llvm::FunctionCallee strcmpFunc = module->getOrInsertFunction(
+          "strcmp", llvm::Type::getInt32Ty(*context), strType, strType);
+
+      llvm::Value *result = builder->CreateCall(strcmpFunc, args, "strcmptmp");
+      llvm::Value *equal =
+          builder->CreateICmpEQ(result, llvm::ConstantInt::get(result->getType(), 0), "streqtmp");
+      return builder->CreateZExt(equal, llvm::Type::getInt32Ty(*context), "streqtmp");
+    }
+    return nullptr;
+  }
+
+  return nullptr;
+}
+
+llvm::Value *CodeGenerator::generateStrAt(llvm::Value *str, llvm::Value *index,
+                                          std::optional<size_t> literalLength) {
+  llvm::Type *sizeType = builder->getIntPtrTy(module->getDataLayout());
+  llvm::Value *wideIndex = builder->CreateSExt(index, sizeType, "idxtmp");
+
+  // Unsigned compares reject negative indices along with ones past the end
+  llvm::Value *inBounds = nullptr;
+  if (literalLength) {
+    inBounds = builder->CreateICmpULT(wideIndex, llvm::ConstantInt::get(sizeType, *literalLength),
+                                      "inbounds");
+  } else {
+    // strnlen(str, index + 1) only scans up to the requested char
+    llvm::FunctionCallee strnlenFunc = module->getOrInsertFunction(
+        "strnlen", sizeType, llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0), sizeType);
+    llvm::Value *prefixLen = builder->CreateCall(
+        strnlenFunc, {str, builder->CreateAdd(wideIndex, llvm::ConstantInt::get(sizeType, 1))},
+        "prefixlen");
+    inBounds = builder->CreateICmpUGT(prefixLen, wideIndex, "inbounds");
+  }
+
+  llvm::Function *func = builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *checkBlock = builder->GetInsertBlock();
+  llvm::BasicBlock *loadBlock = llvm::BasicBlock::Create(*context, "str_at.load", func);
+  llvm::BasicBlock *mergeBlock = llvm::BasicBlock::Create(*context, "str_at.cont", func);
+
+  builder->CreateCondBr(inBounds, loadBlock, mergeBlock);
+
+  builder->SetInsertPoint(loadBlock);
+  llvm::Value *charPtr =
+      builder->CreateInBoundsGEP(llvm::Type::getInt8Ty(*context), str, wideIndex, "charptr");
+  llvm::Value *charValue = builder->CreateLoad(llvm::Type::getInt8Ty(*context), charPtr, "chartmp");
+  builder->CreateBr(mergeBlock);
+
+  builder->SetInsertPoint(mergeBlock);
+  llvm::PHINode *phi = builder->CreatePHI(llvm::Type::getInt8Ty(*context), 2, "str_at");
+  phi->addIncoming(llvm::ConstantInt::get(llvm::Type::getInt8Ty(*context), 0), checkBlock);
+  phi->addIncoming(charValue, loadBlock);
+
+  return phi;
+}
+
+llvm::Constant *CodeGenerator::internString(const std::string &value) {
+  // The runtime only ever sees the string up to its first NUL
+  const std::string key = value.substr(0, value.find('\0'));
+
+  auto it = stringPool.find(key);
+  if (it != stringPool.end()) {
+    return it->second;
+  }
+
+  llvm::Constant *data = llvm::ConstantDataArray::getString(*context, key);
+  auto *global = new llvm::GlobalVariable(*module, data->getType(), true,
+                                          llvm::GlobalValue::PrivateLinkage, data, "str");
+  global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+  global->setAlignment(llvm::Align(1));
+
+  llvm::Constant *zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), 0);
+  llvm::Constant *indices[] = {zero, zero};
+  llvm::Constant *pointer =
+      llvm::ConstantExpr::getInBoundsGetElementPtr(data->getType(), global, indices);
+
+  stringPool.emplace(key, pointer);
+  literalLengths.emplace(pointer, key.size());
+  return pointer;
+}
+
+std::optional<size_t> CodeGenerator::literalLength(const llvm::Value *value) const {
+  auto it = literalLengths.find(value);
+  if (it != literalLengths.end()) {
+    return it->second;
+  }
+  return std::nullopt;
+}
+
+bool CodeGenerator::registerFunction(const FunctionDef &func, bool reportDuplicate) {
+  auto [previous, inserted] = definitions.emplace(func.name, &func);
+  if (inserted)
+    return true;
+
+  // Only the generator emitting the duplicate's body reports it, so a
+  // sharded build prints it once
+  if (reportDuplicate) {
+    const Location &loc = previous->second->location;
+    reportError("Duplicate definition of function: " + func.name + " (previously defined at " +
+                    loc.filename + ":" + std::to_string(loc.line) + ":" +
+                    std::to_string(loc.column) + ")",
+                func.location);
+  }
+  return false;
+}
+
+llvm::Function *CodeGenerator::lookupFunction(const std::string &name) {
+  auto it = functions.find(name);
+  if (it != functions.end()) {
+    return it->second;
+  }
+
+  auto definition = definitions.find(name);
+  if (definition != definitions.end()) {
+    return declareFunction(*definition->second);
+  }
+
+  return nullptr;
+}
+
+llvm::Function *CodeGenerator::declareFunction(const FunctionDef &func) {
+  llvm::Type *returnType = llvmType(*func.returnType);
+  if (!returnType)
+    return nullptr;
+
+  std::vector<llvm::Type *> paramTypes;
+  for (const auto &param : func.parameters) {
+    llvm::Type *paramType = llvmType(*param.type);
+    if (!paramType)
+      return nullptr;
+    paramTypes.push_back(paramType);
+  }
+
+  llvm::FunctionType *funcType = llvm::FunctionType::get(returnType, paramTypes, false);
+
+  llvm::Function *function =
+      llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, func.name, module.get());
+
+  // Set arg names
+  unsigned idx = 0;
+  for (auto &arg : function->args()) {
+    arg.setName(func.parameters[idx++].name);
+  }
+
+  // Bools cross calls zero extended like a C bool, so emitted objects can
+  // be called from C
+  if (returnType->isIntegerTy(1)) {
+    function->addRetAttr(llvm::Attribute::ZExt);
+  }
+  for (auto &arg : function->args()) {
+    if (arg.getType()->isIntegerTy(1)) {
+      arg.addAttr(llvm::Attribute::ZExt);
+    }
+  }
+
+  functions[func.name] = function;
+  return function;
+}
+
+llvm::Function *CodeGenerator::generateFunction(const FunctionDef &func) {
+  llvm::TimeTraceScope timeScope("CodeGen Function", func.name);
+
+  llvm::Function *function = functions.at(func.name);
+
+  // Create block
+  llvm::BasicBlock *entry = llvm::BasicBlock::Create(*context, "entry", function);
+  builder->SetInsertPoint(entry);
+
+  currentFunction = function;
+  namedValues.clear();
+
+  for (auto &arg : function->args()) {
+    namedValues[std::string(arg.getName())] = &arg;
+  }
+
+  llvm::Value *retVal = generateExpression(*func.body);
+  if (retVal) {
+    retVal = convertTo(retVal, *func.body, function->getReturnType());
+  }
+  if (retVal && retVal->getType() != function->getReturnType()) {
+    reportError("Function " + func.name + " returns " + func.returnType->toString() +
+                    ", its body is " + typeName(retVal->getType(), *func.body),
+                func.body->location);
+    retVal = nullptr;
+  }
+  if (retVal) {
+    builder->CreateRet(retVal);
+
+    std::string errorString;
+    llvm::raw_string_ostream errorStream(errorString);
+    if (llvm::verifyFunction(*function, &errorStream)) {
+      std::cerr << "Function verification failed for " << func.name << ": " << errorString
+                << std::endl;
+    }
+
+    return function;
+  }
+
+  // Error occurred => drop the body, other functions may already call it
+  function->deleteBody();
+  return nullptr;
+}
+
+llvm::Value *CodeGenerator::convertTo(llvm::Value *value, const Expression &expr,
+                                      llvm::Type *type) {
+  llvm::Type *from = value->getType();
+  if (from == type)
+    return value;
+
+  // Literals are emitted again at the requested width, so `x + 1` stays an
+  // i8 addition for an i8 x and 0.1 is exact as an f64
+  if (type->isIntegerTy() && !type->isIntegerTy(1)) {
+    if (auto literal = integerLiteral(expr)) {
+      return llvm::isIntN(type->getIntegerBitWidth(), *literal)
+                 ? llvm::ConstantInt::get(type, *literal, true)
+                 : value;
+    }
+  }
+  if (type->isFloatingPointTy()) {
+    if (auto literal = floatLiteral(expr)) {
+      return llvm::ConstantFP::get(type, *literal);
+    }
+  }
+
+  // Tuples and records convert field by field, with the literal's fields
+  // standing in for the fields of a literal
+  const auto *fieldNames = recordFieldNames(from);
+  if (fieldNames && recordFieldNames(type) && *fieldNames == *recordFieldNames(type) &&
+      from->getStructNumElements() == type->getStructNumElements()) {
+    const auto *literal = dynamic_cast<const RecordLiteral *>(&expr);
+    llvm::Value *converted = llvm::PoisonValue::get(type);
+    for (unsigned i = 0; i < type->getStructNumElements(); i++) {
+      llvm::Value *field = builder->CreateExtractValue(value, i, "field");
+      field = convertTo(field, literal ? *literal->fields[i] : expr,
+                        type->getStructElementType(i));
+      if (field->getType() != type->getStructElementType(i))
+        return value;
+      converted = builder->CreateInsertValue(converted, field, i, "record");
+    }
+    return converted;
+  }
+
+  // Bools count as 0 or 1, numbers never narrow to a bool implicitly
+  if (from->isIntegerTy(1) && type->isIntegerTy() && !type->isIntegerTy(1)) {
+    return builder->CreateZExt(value, type, "zexttmp");
+  }
+  if (from->isIntegerTy() && type->isIntegerTy() &&
+      from->getIntegerBitWidth() < type->getIntegerBitWidth()) {
+    return builder->CreateSExt(value, type, "sexttmp");
+  }
+  if (from->isFloatTy() && type->isDoubleTy()) {
+    return builder->CreateFPExt(value, type, "fpexttmp");
+  }
+  return value;
+}
+
+bool CodeGenerator::unifyOperands(llvm::Value *&left, const Expression &leftExpr,
+                                  llvm::Value *&right, const Expression &rightExpr) {
+  if (left->getType() == right->getType())
+    return true;
+
+  // A scalar operand is broadcast to every lane of a vector one
+  auto *leftVector = llvm::dyn_cast<llvm::FixedVectorType>(left->getType());
+  auto *rightVector = llvm::dyn_cast<llvm::FixedVectorType>(right->getType());
+  if (leftVector && !rightVector) {
+    right = convertTo(right, rightExpr, leftVector->getElementType());
+    if (right->getType() != leftVector->getElementType())
+      return false;
+    right = builder->CreateVectorSplat(leftVector->getNumElements(), right, "splat");
+    return true;
+  }
+  if (rightVector && !leftVector) {
+    left = convertTo(left, leftExpr, rightVector->getElementType());
+    if (left->getType() != rightVector->getElementType())
+      return false;
+    left = builder->CreateVectorSplat(rightVector->getNumElements(), left, "splat");
+    return true;
+  }
+
+  // A literal takes the other operand's type, otherwise the narrower
+  // operand widens
+  const bool leftIsLiteral = integerLiteral(leftExpr) || floatLiteral(leftExpr);
+  if (leftIsLiteral) {
+    left = convertTo(left, leftExpr, right->getType());
+  }
+  right = convertTo(right, rightExpr, left->getType());
+  left = convertTo(left, leftExpr, right->getType());
+  return left->getType() == right->getType();
+}
+
+llvm::Value *CodeGenerator::generateConversion(const FunctionCall &call) {
+  if (call.args.size() != 1) {
+    reportError("Incorrect number of arguments for function: " + call.funcName, call.location);
+    return nullptr;
+  }
+
+  llvm::Value *value = generateExpression(*call.args[0]);
+  if (!value)
+    return nullptr;
+
+  // to_i8 ... to_i64, to_f32, to_f64
+  const std::string target = call.funcName.substr(3);
+  llvm::Type *type = nullptr;
+  if (target == "f32") {
+    type = llvm::Type::getFloatTy(*context);
+  } else if (target == "f64") {
+    type = llvm::Type::getDoubleTy(*context);
+  } else {
+    type = llvm::IntegerType::get(*context, std::stoi(target.substr(1)));
+  }
+
+  llvm::Type *from = value->getType();
+  if (!from->isIntegerTy() && !from->isFloatingPointTy()) {
+    reportError(call.funcName + " expects a number, got " + typeName(from), call.location);
+    return nullptr;
+  }
+  if (from == type)
+    return value;
+
+  // Comparison results (i1) count as 0 or 1
+  const bool isFlag = from->isIntegerTy(1);
+  if (from->isIntegerTy() && type->isIntegerTy()) {
+    return isFlag ? builder->CreateZExt(value, type, "convtmp")
+                  : builder->CreateSExtOrTrunc(value, type, "convtmp");
+  }
+  if (from->isIntegerTy()) {
+    return isFlag ? builder->CreateUIToFP(value, type, "convtmp")
+                  : builder->CreateSIToFP(value, type, "convtmp");
+  }
+  if (type->isIntegerTy()) {
+    // Saturates instead of giving poison for out of range values, NaN is 0
+    return builder->CreateIntrinsic(llvm::Intrinsic::fptosi_sat, {type, from}, {value}, nullptr,
+                                    "convtmp");
+  }
+  return builder->CreateFPCast(value, type, "convtmp");
+}
+
+llvm::Value *CodeGenerator::generateCondition(const Expression &expr, const std::string &context) {
+  llvm::Value *condition = generateExpression(expr);
+  if (!condition)
+    return nullptr;
+
+  llvm::Type *type = condition->getType();
+  if (type->isIntegerTy(1)) {
+    return condition;
+  } else if (type->isIntegerTy()) {
+    return builder->CreateICmpNE(condition, llvm::ConstantInt::get(type, 0), "condtmp");
+  } else if (type->isFloatingPointTy()) {
+    return builder->CreateFCmpONE(condition, llvm::ConstantFP::get(type, 0.0), "condtmp");
+  }
+
+  reportError("Invalid condition type for " + context + ": " + typeName(type), expr.location);
+  return nullptr;
+}
+
+llvm::Value *CodeGenerator::generateShortCircuit(const BinaryOp &binOp) {
+  const bool isAnd = binOp.op == BinaryOp::AND;
+  llvm::Value *left = generateCondition(*binOp.left, isAnd ? "and" : "or");
+  if (!left)
+    return nullptr;
+
+  llvm::BasicBlock *leftBlock = builder->GetInsertBlock();
+  llvm::Function *func = leftBlock->getParent();
+  llvm::BasicBlock *rightBlock =
+      llvm::BasicBlock::Create(*context, isAnd ? "and.rhs" : "or.rhs", func);
+  llvm::BasicBlock *mergeBlock =
+      llvm::BasicBlock::Create(*context, isAnd ? "and.cont" : "or.cont", func);
+
+  // false and ... / true or ... skip the right operand
+  if (isAnd) {
+    builder->CreateCondBr(left, rightBlock, mergeBlock);
+  } else {
+    builder->CreateCondBr(left, mergeBlock, rightBlock);
+  }
+
+  builder->SetInsertPoint(rightBlock);
+  llvm::Value *right = generateCondition(*binOp.right, isAnd ? "and" : "or");
+  if (!right)
+    return nullptr;
+  builder->CreateBr(mergeBlock);
+  rightBlock = builder->GetInsertBlock(); // Update in case of nested expr
+
+  builder->SetInsertPoint(mergeBlock);
+  llvm::PHINode *phi = builder->CreatePHI(builder->getInt1Ty(), 2, isAnd ? "andtmp" : "ortmp");
+  phi->addIncoming(builder->getInt1(!isAnd), leftBlock);
+  phi->addIncoming(right, rightBlock);
+  return phi;
+}
+
+llvm::Value *CodeGenerator::generateVectorBuiltin(const FunctionCall &call) {
+  const std::string &name = call.funcName;
+
+  // splat4f(x) and pack4f(x0, x1, x2, x3) build a vector from scalars
+  if (name.starts_with("splat") || name.starts_with("pack")) {
+    const unsigned lanes = name[name.size() - 2] - '0';
+    llvm::Type *elementType = name.back() == 'f' ? llvm::Type::getFloatTy(*context)
+                                                 : llvm::Type::getInt32Ty(*context);
+    const bool isSplat = name.starts_with("splat");
+    if (call.args.size() != (isSplat ? 1 : lanes)) {
+      reportError("Incorrect number of arguments for function: " + name, call.location);
+      return nullptr;
+    }
+
+    std::vector<llvm::Value *> values;
+    for (const auto &arg : call.args) {
+      llvm::Value *value = generateExpression(*arg);
+      if (!value)
+        return nullptr;
+      value = convertTo(value, *arg, elementType);
+      if (value->getType() != elementType) {
+        reportError(name + " expects " + typeName(elementType) + ", got " +
+                        typeName(value->getType()),
+                    arg->location);
+        return nullptr;
+      }
+      values.push_back(value);
+    }
+
+    if (isSplat) {
+      return builder->CreateVectorSplat(lanes, values[0], "splat");
+    }
+    llvm::Value *vector = llvm::PoisonValue::get(llvm::FixedVectorType::get(elementType, lanes));
+    for (unsigned i = 0; i < lanes; i++) {
+      vector = builder->CreateInsertElement(vector, values[i], i, "pack");
+    }
+    return vector;
+  }
+
+  const size_t expectedArgs = name == "extract" ? 2 : name == "insert" || name == "select" ? 3 : 1;
+  if (call.args.size() != expectedArgs) {
+    reportError("Incorrect number of arguments for function: " + name, call.location);
+    return nullptr;
+  }
+
+  std::vector<llvm::Value *> args;
+  for (const auto &arg : call.args) {
+    llvm::Value *argValue = generateExpression(*arg);
+    if (!argValue)
+      return nullptr;
+    args.push_back(argValue);
+  }
+
+  // Everything else takes a vector or a mask first
+  auto *vectorType = llvm::dyn_cast<llvm::FixedVectorType>(args[0]->getType());
+  if (!vectorType) {
+    reportError(name + " expects a vector, got " + typeName(args[0]->getType()), call.location);
+    return nullptr;
+  }
+  llvm::Type *elementType = vectorType->getElementType();
+  const bool isMask = elementType->isIntegerTy(1);
+
+  if (name == "any" || name == "all") {
+    if (!isMask) {
+      reportError(name + " expects a mask, the result of comparing vectors", call.location);
+      return nullptr;
+    }
+    return name == "any" ? builder->CreateOrReduce(args[0]) : builder->CreateAndReduce(args[0]);
+  }
+
+  if (name == "select") {
+    // Scalars are broadcast like for operators
+    llvm::Value *thenValue = args[1], *elseValue = args[2];
+    const bool unified = unifyOperands(thenValue, *call.args[1], elseValue, *call.args[2]);
+    auto *valueType = llvm::dyn_cast<llvm::FixedVectorType>(thenValue->getType());
+    if (!isMask || !unified || !valueType ||
+        valueType->getNumElements() != vectorType->getNumElements()) {
+      reportError("select expects a mask and two vectors with as many lanes", call.location);
+      return nullptr;
+    }
+    return builder->CreateSelect(args[0], thenValue, elseValue, "select");
+  }
+
+  if (isMask) {
+    reportError(name + " expects a vector, got " + typeName(args[0]->getType()), call.location);
+    return nullptr;
+  }
+
+  if (name == "extract" || name == "insert") {
+    llvm::Type *intType = llvm::Type::getInt32Ty(*context);
+    llvm::Value *index = convertTo(args[1], *call.args[1], intType);
+    if (index->getType() != intType) {
+      reportError("Lane index must be an int", call.args[1]->location);
+      return nullptr;
+    }
+
+    // Lanes out of range read as 0 and are never written, like array
+    // elements. Constant indices fold to a plain extract or insert.
+    llvm::Value *inBounds = builder->CreateICmpULT(
+        index, llvm::ConstantInt::get(intType, vectorType->getNumElements()), "inbounds");
+
+    if (name == "extract") {
+      llvm::Value *lane = builder->CreateExtractElement(args[0], index, "lane");
+      return builder->CreateSelect(inBounds, lane, llvm::Constant::getNullValue(elementType),
+                                   "extract");
+    }
+
+    llvm::Value *value = convertTo(args[2], *call.args[2], elementType);
+    if (value->getType() != elementType) {
+      reportError("insert expects " + typeName(elementType) + ", got " +
+                      typeName(value->getType()),
+                  call.args[2]->location);
+      return nullptr;
+    }
+    llvm::Value *inserted = builder->CreateInsertElement(args[0], value, index, "inserted");
+    return builder->CreateSelect(inBounds, inserted, args[0], "insert");
+  }
+
+  // Horizontal reductions
+  const bool isFloat = elementType->isFloatingPointTy();
+  if (name == "reduce_add") {
+    if (!isFloat) {
+      return builder->CreateAddReduce(args[0]);
+    }
+
+    // Reassociation allows a shuffle tree instead of adding lane by lane
+    llvm::Value *sum =
+        builder->CreateFAddReduce(llvm::ConstantFP::getNegativeZero(elementType), args[0]);
+    if (auto *inst = llvm::dyn_cast<llvm::Instruction>(sum)) {
+      inst->setHasAllowReassoc(true);
+    }
+    return sum;
+  }
+  if (name == "reduce_min") {
+    return isFloat ? builder->CreateFPMinReduce(args[0])
+                   : builder->CreateIntMinReduce(args[0], true);
+  }
+  return isFloat ? builder->CreateFPMaxReduce(args[0]) : builder->CreateIntMaxReduce(args[0], true);
+}
+
+std::string CodeGenerator::typeName(const llvm::Type *type) const {
+  if (type->isIntegerTy(1))
+    return "bool";
+  if (type->isIntegerTy())
+    return "i" + std::to_string(type->getIntegerBitWidth());
+  if (type->isFloatTy())
+    return "f32";
+  if (type->isDoubleTy())
+    return "f64";
+  if (type->isPointerTy())
+    return "str";
+  if (const auto *vectorType = llvm::dyn_cast<llvm::FixedVectorType>(type)) {
+    const std::string lanes = std::to_string(vectorType->getNumElements());
+    if (vectorType->getElementType()->isIntegerTy(1))
+      return "a mask of " + lanes + " lanes";
+    return "vec" + lanes + (vectorType->getElementType()->isFloatTy() ? "f" : "i");
+  }
+  if (const llvm::Type *elementType = arrayElementType(type))
+    return elementType->isFloatTy() ? "[float]" : "[int]";
+  if (type->isStructTy() && recordFieldNames(type)) {
+    // Named after its fields by recordType
+    const std::string name = type->getStructName().str();
+    return name.substr(name.find_first_of("({"));
+  }
+  return "an unknown type";
+}
+
+std::string CodeGenerator::typeName(const llvm::Type *type, const Expression &expr) const {
+  const Type *declared = declaredType(expr);
+  if (type->isIntegerTy(8) && declared && declared->kind == Type::CHAR)
+    return "char";
+  return typeName(type);
+}
+
+const Type *CodeGenerator::declaredType(const Expression &expr) const {
+  if (const auto *call = dynamic_cast<const FunctionCall *>(&expr)) {
+    if (namedValues.contains(call->funcName))
+      return nullptr; // Through a function value
+    auto definition = definitions.find(call->funcName);
+    if (definition != definitions.end())
+      return definition->second->returnType.get();
+    return call->funcName == "str_at" ? &charType : nullptr;
+  }
+
+  // Either branch, they have the same type
+  if (const auto *condExpr = dynamic_cast<const ConditionalExpression *>(&expr)) {
+    const Type *thenType = declaredType(*condExpr->thenExpr);
+    return thenType ? thenType : declaredType(*condExpr->elseExpr);
+  }
+  if (const auto *matchExpr = dynamic_cast<const MatchExpression *>(&expr)) {
+    for (const auto &arm : matchExpr->arms) {
+      if (const Type *armType = declaredType(*arm.body))
+        return armType;
+    }
+    return nullptr;
+  }
+  if (const auto *letExpr = dynamic_cast<const LetExpression *>(&expr)) {
+    return declaredType(*letExpr->body);
+  }
+
+  // Tuple fields by position, record fields by name
+  if (const auto *fieldAccess = dynamic_cast<const FieldAccess *>(&expr)) {
+    const Type *record = declaredType(*fieldAccess->record);
+    if (!record || (record->kind != Type::TUPLE && record->kind != Type::RECORD))
+      return nullptr;
+    for (size_t i = 0; i < record->fieldTypes.size(); i++) {
+      const std::string name = record->kind == Type::TUPLE ? std::to_string(i)
+                                                            : record->fieldNames[i];
+      if (name == fieldAccess->field)
+        return record->fieldTypes[i].get();
+    }
+  }
+  return nullptr;
+}
+
+void CodeGenerator::declareBuiltinFunctions() {
+  // str_print function: (str) -> int
+  declareBuiltinFunction("str_print", llvm::Type::getInt32Ty(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0)});
+
+  // str_read function: (int) -> str
+  declareBuiltinFunction("str_read", llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                         {llvm::Type::getInt32Ty(*context)});
+
+  // str_len function: (str) -> int
+  declareBuiltinFunction("str_len", llvm::Type::getInt32Ty(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0)})
+      ->setOnlyReadsMemory();
+
+  // str_at function: (str, int) -> char
+  declareBuiltinFunction("str_at", llvm::Type::getInt8Ty(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                          llvm::Type::getInt32Ty(*context)})
+      ->setOnlyReadsMemory();
+
+  // str_sub function: (str, int, int) -> str
+  declareBuiltinFunction("str_sub", llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                          llvm::Type::getInt32Ty(*context), llvm::Type::getInt32Ty(*context)});
+
+  // str_find function: (str, str) -> int
+  declareBuiltinFunction("str_find", llvm::Type::getInt32Ty(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                          llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0)})
+      ->setOnlyReadsMemory();
+
+  // str_find_from function: (str, str, int) -> int
+  declareBuiltinFunction("str_find_from", llvm::Type::getInt32Ty(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                          llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                          llvm::Type::getInt32Ty(*context)})
+      ->setOnlyReadsMemory();
+
+  // int_to_str function: (int) -> str
+  declareBuiltinFunction("int_to_str", llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                         {llvm::Type::getInt32Ty(*context)});
+
+  // str_to_int function: (str) -> int
+  declareBuiltinFunction("str_to_int", llvm::Type::getInt32Ty(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0)});
+
+  // float_to_str function: (float) -> str
+  declareBuiltinFunction("float_to_str", llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                         {llvm::Type::getFloatTy(*context)});
+
+  // str_to_float function: (str) -> float
+  declareBuiltinFunction("str_to_float", llvm::Type::getFloatTy(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0)});
+
+  // i64_to_str function: (i64) -> str
+  declareBuiltinFunction("i64_to_str", llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                         {llvm::Type::getInt64Ty(*context)});
+
+  // str_to_i64 function: (str) -> i64
+  declareBuiltinFunction("str_to_i64", llvm::Type::getInt64Ty(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0)});
+
+  // f64_to_str function: (f64) -> str
+  declareBuiltinFunction("f64_to_str", llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                         {llvm::Type::getDoubleTy(*context)});
+
+  // str_to_f64 function: (str) -> f64
+  declareBuiltinFunction("str_to_f64", llvm::Type::getDoubleTy(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0)});
+
+  // str_cmp function: (str, str) -> int
+  declareBuiltinFunction("str_cmp", llvm::Type::getInt32Ty(*context),
+                         {llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0),
+                          llvm::PointerType::get(llvm::Type::getInt8Ty(*context), 0)})
+      ->setOnlyReadsMemory();
+}
+
+llvm::Function *CodeGenerator::declareBuiltinFunction(const std::string &name,
+                                                      llvm::Type *returnType,
+                                                      const std::vector<llvm::Type *> &paramTypes) {
+  llvm::FunctionType *funcType = llvm::FunctionType::get(returnType, paramTypes, false);
+  auto *func =
+      llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, name, module.get());
+  func->setCallingConv(llvm::CallingConv::C);
+  func->setDoesNotThrow();
+
+  return func;
+}
+
+void CodeGenerator::applyTargetCPU() {
+  if (options.cpu.empty())
+    return;
+
+  // Per function attributes reach the optimizer's cost models and the
+  // backend, and survive bitcode round trips (shards, function cache)
+  for (auto &func : *module) {
+    if (func.isDeclaration())
+      continue;
+    func.addFnAttr("target-cpu", options.cpu);
+    if (!options.cpuFeatures.empty()) {
+      func.addFnAttr("target-features", options.cpuFeatures);
+    }
+  }
 }
 
 void CodeGenerator::reportError(const std::string &message, const Location &loc) {
-  std::cerr << "Code generation error at " << loc.filename << ":" << loc.line << ":" << loc.column
-            << ": " << message << std::endl;
+  // Formatted first and written at once, shards report from several threads
+  std::ostringstream stream;
+  stream << "Code generation error at " << loc.filename << ":" << loc.line << ":" << loc.column
+         << ": " << message << "\n";
+  std::cerr << stream.str() << std::flush;
+  errorCount++;
 }
 
 } // namespace lge
@@ -0,0 +1,117 @@
+#include "cost_model.h"
+
+#include <algorithm>
+
+namespace lge {
+
+namespace {
+constexpr uint64_t callCost = 5;
+constexpr uint64_t stringBuiltinCost = 20;
+constexpr uint64_t loopBuiltinCost = 1000;
+
+// Builtins whose work grows with their input, everything else is cheap
+const std::unordered_set<std::string> loopBuiltins = {
+    "array_int", "array_float", "array_range", "sum",    "map",      "fold",
+    "zip_with",  "par_map",     "par_reduce",  "str_find", "str_find_from"};
+
+uint64_t add(uint64_t a, uint64_t b) {
+  return a > CostModel::unbounded - b ? CostModel::unbounded : a + b;
+}
+} // namespace
+
+CostModel::CostModel(const Program &program) {
+  // First definition of every name, what calls resolve to
+  for (const auto &func : program.functions) {
+    definitions.emplace(func->name, func.get());
+  }
+  for (const auto &[name, func] : definitions) {
+    functionCost(name);
+  }
+}
+
+uint64_t CostModel::cost(const Expression &expr) const {
+  if (const auto *unaryOp = dynamic_cast<const UnaryOp *>(&expr)) {
+    return add(1, cost(*unaryOp->operand));
+  }
+  if (const auto *binOp = dynamic_cast<const BinaryOp *>(&expr)) {
+    return add(1, add(cost(*binOp->left), cost(*binOp->right)));
+  }
+
+  if (const auto *call = dynamic_cast<const FunctionCall *>(&expr)) {
+    uint64_t total = callCost;
+    for (const auto &arg : call->args) {
+      total = add(total, cost(*arg));
+    }
+
+    if (definitions.contains(call->funcName)) {
+      return add(total, functionCost(call->funcName));
+    }
+    if (loopBuiltins.contains(call->funcName)) {
+      return add(total, loopBuiltinCost);
+    }
+    return add(total, call->funcName.starts_with("str_") ? stringBuiltinCost : 1);
+  }
+
+  // Only one of the branches runs
+  if (const auto *condExpr = dynamic_cast<const ConditionalExpression *>(&expr)) {
+    return add(add(1, cost(*condExpr->condition)),
+               std::max(cost(*condExpr->thenExpr), cost(*condExpr->elseExpr)));
+  }
+
+  if (const auto *arrayLit = dynamic_cast<const ArrayLiteral *>(&expr)) {
+    uint64_t total = callCost;
+    for (const auto &element : arrayLit->elements) {
+      total = add(total, add(1, cost(*element)));
+    }
+    return total;
+  }
+  if (const auto *indexExpr = dynamic_cast<const IndexExpression *>(&expr)) {
+    return add(2, add(cost(*indexExpr->array), cost(*indexExpr->index)));
+  }
+
+  // Records live in registers, building or reading one is cheap
+  if (const auto *recordLit = dynamic_cast<const RecordLiteral *>(&expr)) {
+    uint64_t total = 1;
+    for (const auto &field : recordLit->fields) {
+      total = add(total, cost(*field));
+    }
+    return total;
+  }
+  if (const auto *fieldAccess = dynamic_cast<const FieldAccess *>(&expr)) {
+    return add(1, cost(*fieldAccess->record));
+  }
+  if (const auto *letExpr = dynamic_cast<const LetExpression *>(&expr)) {
+    return add(cost(*letExpr->value), cost(*letExpr->body));
+  }
+
+  // One dispatch, then only one of the arms runs
+  if (const auto *matchExpr = dynamic_cast<const MatchExpression *>(&expr)) {
+    uint64_t armCost = 0;
+    for (const auto &arm : matchExpr->arms) {
+      armCost = std::max(armCost, cost(*arm.body));
+    }
+    return add(add(1, cost(*matchExpr->subject)), armCost);
+  }
+
+  // Literals and identifiers
+  return 1;
+}
+
+uint64_t CostModel::functionCost(const std::string &name) const {
+  auto it = functionCosts.find(name);
+  if (it != functionCosts.end()) {
+    return it->second;
+  }
+
+  // Reached again while computing its own cost
+  if (!visiting.insert(name).second) {
+    return unbounded;
+  }
+
+  const uint64_t bodyCost = cost(*definitions.at(name)->body);
+  visiting.erase(name);
+  functionCosts.emplace(name, bodyCost);
+  return bodyCost;
+}
+
+} // namespace lge
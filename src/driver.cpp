@@ -0,0 +1,371 @@
+#include "driver.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <CLI/CLI.hpp>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/StringSaver.h>
+#include <llvm/TargetParser/Host.h>
+
+#include "ast_format.h"
+#include "backend.h"
+#include "codegen.h"
+#include "optimizer.h"
+#include "repl.h"
+#include "sharding.h"
+#include "timing.h"
+
+namespace {
+const std::unordered_map<std::string, lge::EmitKind> emitKinds = {
+    {"llvm", lge::EmitKind::LLVM},
+    {"bc", lge::EmitKind::BITCODE},
+    {"asm", lge::EmitKind::ASSEMBLY},
+    {"obj", lge::EmitKind::OBJECT}};
+
+// "native" is the host's CPU with every feature it has, "generic" none at all
+lge::CodeGenOptions codeGenOptions(bool autoParallel, const std::string &cpu) {
+  lge::CodeGenOptions options;
+  options.autoParallel = autoParallel;
+  if (cpu == "generic") {
+    return options;
+  }
+  if (cpu != "native") {
+    options.cpu = cpu;
+    return options;
+  }
+
+  options.cpu = llvm::sys::getHostCPUName().str();
+
+  // Sorted, the string is part of the function cache key
+  llvm::StringMap<bool> hostFeatures;
+  if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+    std::map<std::string, bool> sorted;
+    for (const auto &feature : hostFeatures) {
+      sorted.emplace(feature.getKey().str(), feature.getValue());
+    }
+    for (const auto &[name, enabled] : sorted) {
+      options.cpuFeatures += (options.cpuFeatures.empty() ? "" : ",");
+      options.cpuFeatures += (enabled ? "+" : "-") + name;
+    }
+  }
+  return options;
+}
+
+// Installs LLVM's time trace profiler for the lifetime of the scope. It is
+// thread-local, so under --serve a failed request must not leave it behind
+// for the next one on the same thread.
+class TraceProfilerScope {
+public:
+  explicit TraceProfilerScope(bool enabled) : enabled(enabled) {
+    if (enabled) {
+      llvm::timeTraceProfilerInitialize(0, "lgec");
+    }
+  }
+  ~TraceProfilerScope() {
+    if (enabled) {
+      llvm::timeTraceProfilerCleanup();
+    }
+  }
+
+  TraceProfilerScope(const TraceProfilerScope &) = delete;
+  TraceProfilerScope &operator=(const TraceProfilerScope &) = delete;
+
+private:
+  bool enabled;
+};
+} // namespace
+
+namespace lge {
+
+int runCompiler(int argc, const char *const *argv, ASTCache *astCache) {
+  CLI::App app{"LGE"};
+
+  std::string traceFile, outputFile, emitKind = "llvm", cacheDir, cpu = "generic";
+  std::vector<std::string> inputFiles, libraries;
+  bool dumpTokens = false, dumpAST = false, linkRuntime = false, timeReport = false, run = false,
+       repl = false, autoParallel = false;
+  unsigned optLevel = 0, jobs = std::max(1u, std::thread::hardware_concurrency()), shards = 1;
+  uint64_t cacheSizeMb = 1024;
+
+  app.add_option("input_files", inputFiles, "Input LGE source files (or @file with a list of them)")
+      ->check(CLI::ExistingFile);
+
+  app.add_flag("--dump-tokens", dumpTokens, "Dump lexer tokens to stdout");
+  app.add_flag("--dump-ast", dumpAST, "Dump AST to stdout");
+  app.add_option("-O", optLevel, "Optimization level")->check(CLI::Range(0, 3));
+  app.add_flag("--auto-par", autoParallel,
+               "Run expensive independent pure calls as parallel tasks on the runtime's workers");
+  app.add_option("--cpu", cpu,
+                 "CPU to generate code for, e.g. native or x86-64-v3 (default: generic)");
+  app.add_flag("--link-runtime", linkRuntime,
+               "Link the runtime bitcode into the module before optimization");
+  app.add_flag("--time-report", timeReport, "Print time and memory used by each phase to stderr");
+  app.add_option("--trace-out", traceFile, "Write a Chrome trace of the compilation to file");
+  app.add_option("--emit", emitKind, "Output kind")
+      ->check(CLI::IsMember({"llvm", "bc", "asm", "obj", "ast"}));
+  app.add_option("-o,--output", outputFile, "Output file (default: stdout)");
+  app.add_flag("--run", run, "JIT compile and run main() instead of emitting output");
+  app.add_flag("--repl", repl,
+               "Read definitions and expressions from stdin and evaluate them with the JIT");
+  app.add_option("--load", libraries, "Shared library to load for --run (e.g. the runtime)")
+      ->allow_extra_args(false);
+  app.add_option("-j,--jobs", jobs, "Threads used to lex and parse the input files")
+      ->check(CLI::PositiveNumber);
+  app.add_option("--shards", shards,
+                 "Generate and optimize functions in this many modules on parallel threads")
+      ->check(CLI::PositiveNumber);
+  app.add_option("--cache-dir", cacheDir,
+                 "Reuse optimized functions from this directory across compilations");
+  app.add_option("--cache-size", cacheSizeMb, "Size limit of the function cache in MB")
+      ->check(CLI::PositiveNumber);
+
+  // Expand @file arguments (whitespace separated, GNU quoting) before parsing
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver(allocator);
+  llvm::SmallVector<const char *, 64> args(argv, argv + argc);
+  if (!llvm::cl::ExpandResponseFiles(saver, llvm::cl::TokenizeGNUCommandLine, args)) {
+    std::cerr << "Error: Failed to read response file" << std::endl;
+    return 1;
+  }
+
+  CLI11_PARSE(app, static_cast<int>(args.size()), args.data());
+
+  // The REPL can start without any definitions
+  if (inputFiles.empty() && !repl) {
+    std::cerr << "Error: No input files" << std::endl;
+    return 1;
+  }
+
+  // Sharded objects are emitted one per shard, the runtime can only go into one of them.
+  // The function cache always links its per-function shards.
+  const bool splitObjects = shards > 1 && emitKind == "obj" && !run && cacheDir.empty();
+  if (splitObjects && linkRuntime) {
+    std::cerr << "Error: --link-runtime can't be combined with sharded object output" << std::endl;
+    return 1;
+  }
+
+  // Outlives the phase timer, whose scopes record into it
+  TraceProfilerScope traceProfiler(!traceFile.empty());
+
+  const lge::CodeGenOptions options = codeGenOptions(autoParallel, cpu);
+
+  // Only the compile server passes an AST cache, its peak RSS isn't this request's
+  lge::PhaseTimer timer(/*reportPeakRss=*/!astCache);
+  int exitCode = 0;
+
+  try {
+    /** Lexical analysis and parsing, one file per thread **/
+    std::vector<std::shared_ptr<lge::Program>> programs(inputFiles.size());
+    std::vector<std::string> cacheKeys(inputFiles.size());
+    std::vector<std::string> parseFiles;
+    std::vector<size_t> parseIndices;
+
+    for (size_t i = 0; i < inputFiles.size(); i++) {
+      if (astCache) {
+        llvm::SmallString<256> path(inputFiles[i]);
+        llvm::sys::fs::make_absolute(path);
+        cacheKeys[i] = std::string(path);
+        programs[i] = astCache->lookup(cacheKeys[i]);
+      }
+      if (programs[i]) {
+        continue;
+      }
+
+      if (lge::isASTFile(inputFiles[i])) {
+        // Precompiled, skips the front end
+        auto phase = timer.phase("Load AST");
+        programs[i] = lge::readAST(inputFiles[i]);
+        if (astCache) {
+          astCache->insert(cacheKeys[i], programs[i]);
+        }
+      } else {
+        parseFiles.push_back(inputFiles[i]);
+        parseIndices.push_back(i);
+      }
+    }
+
+    // Files are lexed and parsed on worker threads, each phase is the sum
+    // of its time on every thread
+    std::vector<lge::SourceUnit> units;
+    {
+      llvm::TimeTraceScope traceScope("Lex + Parse");
+      units = lge::parseSources(parseFiles, jobs);
+    }
+    if (!units.empty()) {
+      lge::ThreadTime lexTime, parseTime;
+      for (const auto &unit : units) {
+        lexTime += unit.lexTime;
+        parseTime += unit.parseTime;
+      }
+      timer.record("Lex", lexTime);
+      timer.record("Parse", parseTime);
+    }
+
+    bool parseFailed = false;
+    for (size_t k = 0; k < units.size(); k++) {
+      auto &unit = units[k];
+      if (unit.error) {
+        std::rethrow_exception(unit.error);
+      }
+
+      if (unit.parser->hasErrors()) {
+        std::cerr << "Parse errors occurred";
+        if (inputFiles.size() > 1) {
+          std::cerr << " in " << unit.filename;
+        }
+        std::cerr << ":" << std::endl;
+        unit.parser->printErrors();
+        parseFailed = true;
+        continue;
+      }
+
+      const size_t index = parseIndices[k];
+      programs[index] = unit.program;
+      if (astCache) {
+        astCache->insert(cacheKeys[index], unit.program);
+      }
+    }
+
+    if (dumpTokens) {
+      // Parsed units have drained their lexers, cached ones have none
+      for (const auto &filename : inputFiles) {
+        if (lge::isASTFile(filename))
+          continue;
+        std::cout << "Tokens: " << std::endl;
+        lge::Lexer(filename).dumpTokens();
+        std::cout << "END Tokens" << std::endl;
+      }
+    }
+
+    if (parseFailed) {
+      return 1;
+    }
+
+    std::unique_ptr<lge::Program> program = lge::mergePrograms(programs);
+
+    if (dumpAST) {
+      std::cout << "AST: " << std::endl;
+      program->dump();
+      std::cout << "END AST" << std::endl;
+    }
+
+    if (repl) {
+      /** Interactive session, the input files are its first definitions **/
+      return lge::runRepl(*program, libraries, optLevel, options);
+    }
+
+    if (emitKind == "ast" && !run) {
+      /** Serialized AST, code generation happens when it is loaded **/
+      auto phase = timer.phase("Emit");
+      lge::writeAST(*program, outputFile);
+    } else {
+      /** Code generation **/
+      std::unique_ptr<llvm::LLVMContext> context;
+      std::unique_ptr<llvm::Module> module;
+      std::optional<lge::FunctionCache> cache;
+      std::optional<lge::ShardedCompiler> sharded;
+
+      if (!cacheDir.empty()) {
+        cache.emplace(cacheDir, cacheSizeMb * 1024 * 1024);
+      }
+
+      if (shards > 1 || cache) {
+        sharded.emplace(*program, shards, cache ? &*cache : nullptr);
+        {
+          auto phase = timer.phase("IR generation + Optimize");
+          if (!sharded->compile(optLevel, options)) {
+            return 1;
+          }
+        }
+
+        if (cache && timeReport) {
+          std::cerr << "Function cache: " << cache->hits() << " hits, " << cache->misses()
+                    << " misses" << std::endl;
+        }
+
+        if (!splitObjects) {
+          auto phase = timer.phase("Link shards");
+          context = std::make_unique<llvm::LLVMContext>();
+          module = sharded->link(*context);
+        }
+      } else {
+        lge::CodeGenerator codegen(options);
+        {
+          auto phase = timer.phase("IR generation");
+          codegen.generate(*program);
+        }
+
+        if (codegen.hasErrors()) {
+          return 1;
+        }
+
+        {
+          auto phase = timer.phase("Verify");
+          if (!codegen.verify()) {
+            return 1;
+          }
+        }
+
+        // The module must not outlive its context
+        module = codegen.takeModule();
+        context = codegen.takeContext();
+      }
+
+      if (linkRuntime) {
+        auto phase = timer.phase("Link runtime");
+        lge::linkRuntime(*module);
+      }
+
+      /** Optimization (shards are optimized on their own threads) **/
+      if (!sharded) {
+        auto phase = timer.phase("Optimize");
+        lge::optimizeModule(*module, optLevel);
+      }
+
+      if (run) {
+        /** JIT compile and execute **/
+        auto phase = timer.phase("JIT run");
+        exitCode = lge::runModule(std::move(module), std::move(context), libraries);
+      } else if (splitObjects) {
+        /** One object per shard, for the system linker **/
+        auto phase = timer.phase("Emit");
+        sharded->emitObjects(outputFile);
+      } else {
+        /** Output (LLVM IR to stdout by default) **/
+        auto phase = timer.phase("Emit");
+        lge::emitModule(*module, emitKinds.at(emitKind), outputFile);
+      }
+    }
+
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  if (timeReport) {
+    timer.report(std::cerr);
+  }
+
+  if (!traceFile.empty()) {
+    if (auto error = llvm::timeTraceProfilerWrite(traceFile, inputFiles.front())) {
+      std::cerr << "Error: Failed to write trace: " << llvm::toString(std::move(error))
+                << std::endl;
+      return 1;
+    }
+  }
+
+  return exitCode;
+}
+
+} // namespace lge
@@ -0,0 +1,72 @@
+#include "frontend.h"
+
+#include <llvm/Support/FileSystem.h>
+
+#include "parallel.h"
+
+namespace lge {
+
+namespace {
+void parseUnit(SourceUnit &unit) {
+  try {
+    // The parser tokenizes the whole file up front
+    const ThreadTime start = ThreadTime::now();
+    unit.lexer.emplace(unit.filename);
+    unit.parser.emplace(*unit.lexer);
+    const ThreadTime lexed = ThreadTime::now();
+    unit.program = unit.parser->parse();
+    unit.lexTime = lexed - start;
+    unit.parseTime = ThreadTime::now() - lexed;
+  } catch (...) {
+    unit.error = std::current_exception();
+  }
+}
+} // namespace
+
+std::vector<SourceUnit> parseSources(const std::vector<std::string> &filenames, unsigned jobs) {
+  // Sized up front, workers fill their slots in place
+  std::vector<SourceUnit> units(filenames.size());
+  for (size_t i = 0; i < filenames.size(); i++) {
+    units[i].filename = filenames[i];
+  }
+
+  parallelFor(units.size(), jobs, [&](size_t i) { parseUnit(units[i]); });
+
+  return units;
+}
+
+std::unique_ptr<Program> mergePrograms(const std::vector<std::shared_ptr<Program>> &programs) {
+  auto merged = std::make_unique<Program>(Location());
+
+  for (const auto &program : programs) {
+    merged->functions.insert(merged->functions.end(), program->functions.begin(),
+                             program->functions.end());
+  }
+
+  return merged;
+}
+
+std::shared_ptr<Program> ASTCache::lookup(const std::string &filename) const {
+  auto it = entries.find(filename);
+  if (it == entries.end())
+    return nullptr;
+
+  llvm::sys::fs::file_status status;
+  if (llvm::sys::fs::status(filename, status) ||
+      status.getLastModificationTime() != it->second.modified ||
+      status.getSize() != it->second.size) {
+    return nullptr;
+  }
+
+  return it->second.program;
+}
+
+void ASTCache::insert(const std::string &filename, std::shared_ptr<Program> program) {
+  llvm::sys::fs::file_status status;
+  if (llvm::sys::fs::status(filename, status))
+    return;
+
+  entries[filename] = {status.getLastModificationTime(), status.getSize(), std::move(program)};
+}
+
+} // namespace lge
@@ -0,0 +1,254 @@
+#include "function_cache.h"
+
+#include <bit>
+#include <chrono>
+#include <set>
+#include <stdexcept>
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/CachePruning.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SHA256.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace lge {
+
+namespace {
+// Location-free encoding of an expression, identical for functions that
+// only differ in whitespace, comments or position in the file
+class ASTEncoder {
+public:
+  std::string out;
+  std::set<std::string> references; // Names that may be functions
+
+  void write(const std::string &value) {
+    out += std::to_string(value.size());
+    out += ':';
+    out += value;
+  }
+
+  void encode(const Expression &expr) {
+    if (const auto *intLit = dynamic_cast<const IntLiteral *>(&expr)) {
+      out += 'I';
+      write(std::to_string(intLit->value));
+    } else if (const auto *floatLit = dynamic_cast<const FloatLiteral *>(&expr)) {
+      out += 'F';
+      write(llvm::utohexstr(std::bit_cast<uint64_t>(floatLit->value)));
+    } else if (const auto *boolLit = dynamic_cast<const BoolLiteral *>(&expr)) {
+      out += 'b';
+      write(boolLit->value ? "1" : "0");
+    } else if (const auto *strLit = dynamic_cast<const StringLiteral *>(&expr)) {
+      out += 'S';
+      write(strLit->value);
+    } else if (const auto *ident = dynamic_cast<const Identifier *>(&expr)) {
+      out += 'V';
+      write(ident->name);
+      references.insert(ident->name);
+    } else if (const auto *unaryOp = dynamic_cast<const UnaryOp *>(&expr)) {
+      out += 'U';
+      write(std::to_string(unaryOp->op));
+      encode(*unaryOp->operand);
+    } else if (const auto *binOp = dynamic_cast<const BinaryOp *>(&expr)) {
+      out += 'B';
+      write(std::to_string(binOp->op));
+      encode(*binOp->left);
+      encode(*binOp->right);
+    } else if (const auto *call = dynamic_cast<const FunctionCall *>(&expr)) {
+      out += 'C';
+      write(call->funcName);
+      write(std::to_string(call->args.size()));
+      for (const auto &arg : call->args) {
+        encode(*arg);
+      }
+      references.insert(call->funcName);
+    } else if (const auto *condExpr = dynamic_cast<const ConditionalExpression *>(&expr)) {
+      out += '?';
+      encode(*condExpr->condition);
+      encode(*condExpr->thenExpr);
+      encode(*condExpr->elseExpr);
+    } else if (const auto *arrayLit = dynamic_cast<const ArrayLiteral *>(&expr)) {
+      out += 'A';
+      write(std::to_string(arrayLit->elements.size()));
+      for (const auto &element : arrayLit->elements) {
+        encode(*element);
+      }
+    } else if (const auto *indexExpr = dynamic_cast<const IndexExpression *>(&expr)) {
+      out += '[';
+      encode(*indexExpr->array);
+      encode(*indexExpr->index);
+    } else if (const auto *recordLit = dynamic_cast<const RecordLiteral *>(&expr)) {
+      out += 'R';
+      write(std::to_string(recordLit->fieldNames.size()));
+      for (const auto &name : recordLit->fieldNames) {
+        write(name);
+      }
+      write(std::to_string(recordLit->fields.size()));
+      for (const auto &field : recordLit->fields) {
+        encode(*field);
+      }
+    } else if (const auto *fieldAccess = dynamic_cast<const FieldAccess *>(&expr)) {
+      out += '.';
+      write(fieldAccess->field);
+      encode(*fieldAccess->record);
+    } else if (const auto *letExpr = dynamic_cast<const LetExpression *>(&expr)) {
+      out += letExpr->destructure ? 'L' : 'l';
+      write(std::to_string(letExpr->names.size()));
+      for (const auto &name : letExpr->names) {
+        write(name);
+      }
+      encode(*letExpr->value);
+      encode(*letExpr->body);
+    } else if (const auto *matchExpr = dynamic_cast<const MatchExpression *>(&expr)) {
+      out += 'M';
+      encode(*matchExpr->subject);
+      write(std::to_string(matchExpr->arms.size()));
+      for (const auto &arm : matchExpr->arms) {
+        write(std::to_string(arm.patterns.size()));
+        for (const auto &pattern : arm.patterns) {
+          encode(*pattern);
+        }
+        encode(*arm.body);
+      }
+    } else {
+      // Unknown nodes must never share a key
+      throw std::runtime_error("Function cache can't encode expression");
+    }
+  }
+
+  void signature(const FunctionDef &func) {
+    write(func.name);
+    write(func.returnType->toString());
+    write(std::to_string(func.parameters.size()));
+    for (const auto &param : func.parameters) {
+      write(param.name);
+      write(param.type->toString());
+    }
+  }
+};
+
+// Entries built by a different compiler binary are never reused
+std::string currentCompilerId() {
+  static int anchor;
+  const std::string executable = llvm::sys::fs::getMainExecutable(nullptr, &anchor);
+
+  llvm::sys::fs::file_status status;
+  if (executable.empty() || llvm::sys::fs::status(executable, status)) {
+    return executable;
+  }
+
+  return executable + ":" + std::to_string(status.getSize()) + ":" +
+         std::to_string(status.getLastModificationTime().time_since_epoch().count());
+}
+} // namespace
+
+FunctionCache::FunctionCache(const std::string &directory, uint64_t maxBytes)
+    : directory(directory), maxBytes(maxBytes), compilerId(currentCompilerId()) {
+  if (auto error = llvm::sys::fs::create_directories(directory)) {
+    throw std::runtime_error("Could not create cache directory " + directory + ": " +
+                             error.message());
+  }
+}
+
+std::string FunctionCache::key(
+    const FunctionDef &func,
+    const std::unordered_map<std::string, const FunctionDef *> &definitions,
+    const PurityAnalysis &purity, const CostModel &costModel, unsigned optLevel,
+    const CodeGenOptions &options) const {
+  ASTEncoder encoder;
+  encoder.write(compilerId);
+  encoder.write("O" + std::to_string(optLevel) + (options.autoParallel ? " auto-par" : ""));
+  encoder.write(options.cpu);
+  encoder.write(options.cpuFeatures);
+  encoder.signature(func);
+  encoder.encode(*func.body);
+
+  // A callee changing its signature changes the IR of every caller, one
+  // losing its purity makes par_map over it an error. With --auto-par the
+  // callee's cost decides whether a call to it is spawned as a task.
+  for (const auto &name : encoder.references) {
+    auto it = definitions.find(name);
+    if (it != definitions.end()) {
+      encoder.out += 'D';
+      encoder.signature(*it->second);
+      encoder.out += purity.isPure(name) ? 'P' : 'E';
+      if (options.autoParallel) {
+        encoder.write(std::to_string(costModel.functionCost(name)));
+      }
+    } else {
+      encoder.out += 'X';
+      encoder.write(name);
+    }
+  }
+
+  const auto digest = llvm::SHA256::hash(llvm::arrayRefFromStringRef(encoder.out));
+  return llvm::toHex(digest, true);
+}
+
+std::string FunctionCache::entryPath(const std::string &key) const {
+  // pruneCache only considers files with this prefix
+  llvm::SmallString<128> path(directory);
+  llvm::sys::path::append(path, "llvmcache-" + key);
+  return std::string(path);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> FunctionCache::lookup(const std::string &key) {
+  const std::string path = entryPath(key);
+
+  auto file = llvm::sys::fs::openNativeFileForRead(path);
+  if (!file) {
+    llvm::consumeError(file.takeError());
+    missCount++;
+    return nullptr;
+  }
+
+  auto buffer = llvm::MemoryBuffer::getOpenFile(*file, path, -1);
+
+  // The access time is what pruning orders entries by
+  if (buffer) {
+    (void)llvm::sys::fs::setLastAccessAndModificationTime(*file,
+                                                          std::chrono::system_clock::now());
+  }
+  llvm::sys::fs::closeFile(*file);
+
+  if (!buffer) {
+    missCount++;
+    return nullptr;
+  }
+
+  hitCount++;
+  return std::move(*buffer);
+}
+
+void FunctionCache::store(const std::string &key, llvm::ArrayRef<char> bitcode) {
+  // Written to a temporary first so readers never see a partial entry
+  llvm::SmallString<128> model(directory);
+  llvm::sys::path::append(model, "tmp-%%%%%%%%");
+
+  auto temp = llvm::sys::fs::TempFile::create(model);
+  if (!temp) {
+    llvm::consumeError(temp.takeError());
+    return;
+  }
+
+  {
+    llvm::raw_fd_ostream out(temp->FD, false);
+    out.write(bitcode.data(), bitcode.size());
+  }
+
+  if (auto error = temp->keep(entryPath(key))) {
+    llvm::consumeError(std::move(error));
+    llvm::consumeError(temp->discard());
+  }
+}
+
+void FunctionCache::prune() {
+  llvm::CachePruningPolicy policy;
+  policy.Interval = std::chrono::seconds(0);   // Always scan
+  policy.Expiration = std::chrono::seconds(0); // Only the size limit evicts
+  policy.MaxSizeBytes = maxBytes;
+  policy.MaxSizePercentageOfAvailableSpace = 0;
+  llvm::pruneCache(directory, policy);
+}
+
+} // namespace lge
@@ -17,16 +17,31 @@ constexpr std::string_view toString(const TokenType type) noexcept {
                   {TokenType::STRING_LITERAL, "STRING_LITERAL"},
                   {TokenType::INT_LITERAL, "INT_LITERAL"},
                   {TokenType::FLOAT_LITERAL, "FLOAT_LITERAL"},
+                  {TokenType::CHAR_LITERAL, "CHAR_LITERAL"},
                   {TokenType::LET, "LET"},
+                  {TokenType::IN, "IN"},
                   {TokenType::IF, "IF"},
                   {TokenType::THEN, "THEN"},
                   {TokenType::ELSE, "ELSE"},
+                  {TokenType::MATCH, "MATCH"},
+                  {TokenType::WITH, "WITH"},
+                  {TokenType::TRUE, "TRUE"},
+                  {TokenType::FALSE, "FALSE"},
+                  {TokenType::AND, "AND"},
+                  {TokenType::OR, "OR"},
+                  {TokenType::NOT, "NOT"},
                   {TokenType::ARROW, "ARROW"},
                   {TokenType::PLUS, "PLUS"},
                   {TokenType::MINUS, "MINUS"},
                   {TokenType::MULTIPLY, "MULTIPLY"},
                   {TokenType::DIVIDE, "DIVIDE"},
                   {TokenType::EQUALS, "EQUALS"},
+                  {TokenType::PIPE, "PIPE"},
+                  {TokenType::PERCENT, "PERCENT"},
+                  {TokenType::AMPERSAND, "AMPERSAND"},
+                  {TokenType::CARET, "CARET"},
+                  {TokenType::SHIFT_LEFT, "SHIFT_LEFT"},
+                  {TokenType::SHIFT_RIGHT, "SHIFT_RIGHT"},
                   {TokenType::LESS_THAN, "LESS_THAN"},
                   {TokenType::GREATER_THAN, "GREATER_THAN"},
                   {TokenType::LESS_EQUAL, "LESS_EQUAL"},
@@ -35,13 +50,27 @@ constexpr std::string_view toString(const TokenType type) noexcept {
                   {TokenType::NOT_EQUAL, "NOT_EQUAL"},
                   {TokenType::LPAREN, "LPAREN"},
                   {TokenType::RPAREN, "RPAREN"},
+                  {TokenType::LBRACKET, "LBRACKET"},
+                  {TokenType::RBRACKET, "RBRACKET"},
+                  {TokenType::LBRACE, "LBRACE"},
+                  {TokenType::RBRACE, "RBRACE"},
                   {TokenType::COLON, "COLON"},
                   {TokenType::COMMA, "COMMA"},
+                  {TokenType::DOT, "DOT"},
                   {TokenType::TYPE_INT, "TYPE_INT"},
                   {TokenType::TYPE_FLOAT, "TYPE_FLOAT"},
                   {TokenType::TYPE_CHAR, "TYPE_CHAR"},
                   {TokenType::TYPE_STR, "TYPE_STR"},
                   {TokenType::TYPE_FUNC, "TYPE_FUNC"},
+                  {TokenType::TYPE_I8, "TYPE_I8"},
+                  {TokenType::TYPE_I16, "TYPE_I16"},
+                  {TokenType::TYPE_I64, "TYPE_I64"},
+                  {TokenType::TYPE_F64, "TYPE_F64"},
+                  {TokenType::TYPE_VEC4F, "TYPE_VEC4F"},
+                  {TokenType::TYPE_VEC8F, "TYPE_VEC8F"},
+                  {TokenType::TYPE_VEC4I, "TYPE_VEC4I"},
+                  {TokenType::TYPE_VEC8I, "TYPE_VEC8I"},
+                  {TokenType::TYPE_BOOL, "TYPE_BOOL"},
                   {TokenType::NEWLINE, "NEWLINE"},
                   {TokenType::BACKSLASH, "BACKSLASH"},
                   {TokenType::COMMENT, "COMMENT"},
@@ -54,9 +83,20 @@ constexpr std::string_view toString(const TokenType type) noexcept {
 }
 
 const std::unordered_map<std::string, TokenType> keywords = {
-    {"let", TokenType::LET},        {"if", TokenType::IF},        {"then", TokenType::THEN},
-    {"else", TokenType::ELSE},      {"int", TokenType::TYPE_INT}, {"float", TokenType::TYPE_FLOAT},
-    {"char", TokenType::TYPE_CHAR}, {"str", TokenType::TYPE_STR}, {"func", TokenType::TYPE_FUNC}};
+    {"let", TokenType::LET},          {"in", TokenType::IN},
+    {"if", TokenType::IF},            {"then", TokenType::THEN},
+    {"else", TokenType::ELSE},        {"match", TokenType::MATCH},
+    {"with", TokenType::WITH},        {"true", TokenType::TRUE},
+    {"false", TokenType::FALSE},      {"and", TokenType::AND},
+    {"or", TokenType::OR},            {"not", TokenType::NOT},
+    {"int", TokenType::TYPE_INT},     {"bool", TokenType::TYPE_BOOL},
+    {"float", TokenType::TYPE_FLOAT}, {"char", TokenType::TYPE_CHAR},
+    {"str", TokenType::TYPE_STR},     {"func", TokenType::TYPE_FUNC},
+    {"i8", TokenType::TYPE_I8},       {"i16", TokenType::TYPE_I16},
+    {"i32", TokenType::TYPE_INT},     {"i64", TokenType::TYPE_I64},
+    {"f32", TokenType::TYPE_FLOAT},   {"f64", TokenType::TYPE_F64},
+    {"vec4f", TokenType::TYPE_VEC4F}, {"vec8f", TokenType::TYPE_VEC8F},
+    {"vec4i", TokenType::TYPE_VEC4I}, {"vec8i", TokenType::TYPE_VEC8I}};
 } // namespace
 
 namespace lge {
@@ -117,6 +157,11 @@ Token Lexer::nextToken() {
     return handleString();
   }
 
+  // Handle characters
+  if (c == '\'') {
+    return handleChar();
+  }
+
   // Handle comments
   if (c == '#') {
     return handleComment();
@@ -128,6 +173,16 @@ Token Lexer::nextToken() {
     return makeToken(TokenType::LPAREN, "(");
   case ')':
     return makeToken(TokenType::RPAREN, ")");
+  case '[':
+    return makeToken(TokenType::LBRACKET, "[");
+  case ']':
+    return makeToken(TokenType::RBRACKET, "]");
+  case '{':
+    return makeToken(TokenType::LBRACE, "{");
+  case '}':
+    return makeToken(TokenType::RBRACE, "}");
+  case '.':
+    return makeToken(TokenType::DOT, ".");
   case ',':
     return makeToken(TokenType::COMMA, ",");
   case ':':
@@ -148,6 +203,14 @@ Token Lexer::nextToken() {
       return makeToken(TokenType::EQUAL_EQUAL, "==");
     }
     return makeToken(TokenType::EQUALS, "=");
+  case '|':
+    return makeToken(TokenType::PIPE, "|");
+  case '%':
+    return makeToken(TokenType::PERCENT, "%");
+  case '&':
+    return makeToken(TokenType::AMPERSAND, "&");
+  case '^':
+    return makeToken(TokenType::CARET, "^");
   case '\\':
     return makeToken(TokenType::BACKSLASH, "\\");
   case '\n':
@@ -156,11 +219,17 @@ Token Lexer::nextToken() {
     if (match('=')) {
       return makeToken(TokenType::LESS_EQUAL, "<=");
     }
+    if (match('<')) {
+      return makeToken(TokenType::SHIFT_LEFT, "<<");
+    }
     return makeToken(TokenType::LESS_THAN, "<");
   case '>':
     if (match('=')) {
       return makeToken(TokenType::GREATER_EQUAL, ">=");
     }
+    if (match('>')) {
+      return makeToken(TokenType::SHIFT_RIGHT, ">>");
+    }
     return makeToken(TokenType::GREATER_THAN, ">");
   case '!':
     if (match('=')) {
@@ -277,8 +346,9 @@ Token Lexer::handleNumber() {
     advance();
   }
 
-  // Decimal part
-  if (peek() == '.' && std::isdigit(peek(1))) {
+  // Decimal part, except for field indices: t.0.1 is field 1 of field 0
+  const bool isFieldIndex = start > 0 && input[start - 1] == '.';
+  if (!isFieldIndex && peek() == '.' && std::isdigit(peek(1))) {
     isFloat = true;
     advance(); // Consume '.'
 
@@ -347,6 +417,43 @@ Token Lexer::handleString() {
   return Token(TokenType::STRING_LITERAL, value, Location(line, startColumn, filename));
 }
 
+Token Lexer::handleChar() {
+  const size_t startColumn = column - 1; // Account for opening quote
+  char value = advance();
+
+  if (value == '\\') {
+    switch (char escaped = advance()) {
+    case 'n':
+      value = '\n';
+      break;
+    case 't':
+      value = '\t';
+      break;
+    case 'r':
+      value = '\r';
+      break;
+    case '0':
+      value = '\0';
+      break;
+    default:
+      value = escaped;
+      break;
+    }
+  } else if (value == '\'') {
+    return errorToken("Empty character literal");
+  } else if (value == '\n' || isAtEnd()) {
+    return errorToken("Unterminated character literal");
+  }
+
+  // Non-ASCII characters are more than one byte in UTF-8
+  if (!match('\'')) {
+    return errorToken("Character literal must be a single byte");
+  }
+
+  return Token(TokenType::CHAR_LITERAL, std::string(1, value),
+               Location(line, startColumn, filename));
+}
+
 Token Lexer::handleComment() {
   const size_t startColumn = column - 1; // Account for '#'
   std::string comment = "#";
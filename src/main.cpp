@@ -1,64 +1,19 @@
-#include <iostream>
-#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
-#include <CLI/CLI.hpp>
-
-#include "codegen.h"
-#include "lexer.h"
-#include "parser.h"
+#include "driver.h"
+#include "server.h"
 
 int main(int argc, char **argv) {
-  CLI::App app{"LGE"};
-
-  std::string inputFile;
-  bool dumpTokens = false, dumpAST = false;
-
-  app.add_option("input_file", inputFile, "Input LGE source file")
-      ->required()
-      ->check(CLI::ExistingFile);
-
-  app.add_flag("--dump-tokens", dumpTokens, "Dump lexer tokens to stdout");
-  app.add_flag("--dump-ast", dumpAST, "Dump AST to stdout");
-
-  CLI11_PARSE(app, argc, argv);
-
-  try {
-    /** Lexical analysis **/
-    lge::Lexer lexer(inputFile);
-
-    if (dumpTokens) {
-      std::cout << "Tokens: " << std::endl;
-      lexer.dumpTokens();
-      std::cout << "END Tokens" << std::endl;
-    }
-
-    /** Parsing **/
-    lge::Parser parser(lexer);
-    const auto program = parser.parse();
-
-    if (parser.hasErrors()) {
-      std::cerr << "Parse errors occurred:" << std::endl;
-      parser.printErrors();
-      return 1;
-    }
-
-    if (dumpAST) {
-      std::cout << "AST: " << std::endl;
-      parser.dumpAST(*program);
-      std::cout << "END AST" << std::endl;
-    }
-
-    /** Code generation **/
-    lge::CodeGenerator codegen;
-    codegen.generate(*program);
-
-    /** Output LLVM IR to stdout **/
-    codegen.emitIR();
-
-  } catch (const std::exception &e) {
-    std::cerr << "Error: " << e.what() << std::endl;
-    return 1;
+  // lgec --serve <socket> keeps a compiler running,
+  // lgec --connect <socket> <options...> compiles on it
+  if (argc >= 3 && std::string_view(argv[1]) == "--serve") {
+    return lge::serve(argv[2]);
+  }
+  if (argc >= 3 && std::string_view(argv[1]) == "--connect") {
+    return lge::connectAndRun(argv[2], std::vector<std::string>(argv + 3, argv + argc));
   }
 
-  return 0;
+  return lge::runCompiler(argc, argv);
 }
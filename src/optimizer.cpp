@@ -0,0 +1,119 @@
+#include "optimizer.h"
+
+#include <stdexcept>
+#include <unordered_set>
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/StandardInstrumentations.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/TargetParser/Host.h>
+
+#ifdef LGE_HAS_RUNTIME_BITCODE
+#include "lge_runtime_bc.h"
+#endif
+
+namespace lge {
+
+std::unique_ptr<llvm::TargetMachine> createHostTargetMachine() {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  const std::string triple = llvm::sys::getDefaultTargetTriple();
+
+  std::string error;
+  const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    throw std::runtime_error("Failed to find target for " + triple + ": " + error);
+  }
+
+  llvm::TargetOptions options;
+  return std::unique_ptr<llvm::TargetMachine>(
+      target->createTargetMachine(triple, "generic", "", options, llvm::Reloc::PIC_));
+}
+
+void linkRuntime(llvm::Module &module) {
+#ifdef LGE_HAS_RUNTIME_BITCODE
+  const llvm::StringRef bitcode(reinterpret_cast<const char *>(runtimeBitcode),
+                                sizeof(runtimeBitcode));
+  auto buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, "lge_runtime.bc", false);
+
+  auto runtime = llvm::parseBitcodeFile(buffer->getMemBufferRef(), module.getContext());
+  if (!runtime) {
+    throw std::runtime_error("Failed to load runtime bitcode: " +
+                             llvm::toString(runtime.takeError()));
+  }
+
+  // Remember what the runtime defines, the linker moves it into module
+  std::unordered_set<std::string> runtimeSymbols;
+  for (const auto &func : **runtime) {
+    if (!func.isDeclaration()) {
+      runtimeSymbols.insert(func.getName().str());
+    }
+  }
+
+  if (llvm::Linker::linkModules(module, std::move(*runtime), llvm::Linker::LinkOnlyNeeded)) {
+    throw std::runtime_error("Failed to link runtime bitcode");
+  }
+
+  for (auto &func : module) {
+    if (!func.isDeclaration() && runtimeSymbols.count(func.getName().str())) {
+      func.setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  }
+#else
+  (void)module;
+  throw std::runtime_error("lgec was built without runtime bitcode (clang not found)");
+#endif
+}
+
+void optimizeModule(llvm::Module &module, unsigned optLevel) {
+  if (optLevel == 0) {
+    return;
+  }
+
+  auto targetMachine = createHostTargetMachine();
+  if (module.getTargetTriple().empty()) {
+    module.setTargetTriple(targetMachine->getTargetTriple().str());
+    module.setDataLayout(targetMachine->createDataLayout());
+  }
+
+  llvm::LoopAnalysisManager loopAM;
+  llvm::FunctionAnalysisManager functionAM;
+  llvm::CGSCCAnalysisManager cgsccAM;
+  llvm::ModuleAnalysisManager moduleAM;
+
+  // Standard instrumentations also emit per-pass time trace events
+  llvm::PassInstrumentationCallbacks instrumentation;
+  llvm::StandardInstrumentations standardInstrumentations(module.getContext(), false);
+  standardInstrumentations.registerCallbacks(instrumentation, &moduleAM);
+
+  llvm::PassBuilder passBuilder(targetMachine.get(), llvm::PipelineTuningOptions(), std::nullopt,
+                                &instrumentation);
+  passBuilder.registerModuleAnalyses(moduleAM);
+  passBuilder.registerCGSCCAnalyses(cgsccAM);
+  passBuilder.registerFunctionAnalyses(functionAM);
+  passBuilder.registerLoopAnalyses(loopAM);
+  passBuilder.crossRegisterProxies(loopAM, functionAM, cgsccAM, moduleAM);
+
+  llvm::OptimizationLevel level = llvm::OptimizationLevel::O2;
+  switch (optLevel) {
+  case 1:
+    level = llvm::OptimizationLevel::O1;
+    break;
+  case 2:
+    level = llvm::OptimizationLevel::O2;
+    break;
+  default:
+    level = llvm::OptimizationLevel::O3;
+    break;
+  }
+
+  llvm::ModulePassManager passManager = passBuilder.buildPerModuleDefaultPipeline(level);
+  passManager.run(module, moduleAM);
+}
+
+} // namespace lge
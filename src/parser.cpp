@@ -1,10 +1,71 @@
 #include "parser.h"
 
+#include <charconv>
 #include <iostream>
+#include <optional>
 #include <sstream>
 
+#include <llvm/Support/MathExtras.h>
+
 namespace lge {
 
+namespace {
+// Sets a parser flag for the lifetime of the scope, also when parsing throws
+class FlagScope {
+public:
+  FlagScope(bool &flag, bool value) : flag(flag), saved(flag) { flag = value; }
+  ~FlagScope() { flag = saved; }
+
+private:
+  bool &flag;
+  bool saved;
+};
+
+// Value of an integer operation on two literals, computed at the width code
+// generation gives them (i32 unless one needs i64) with the same wrapping and
+// shift masking, nothing if it is undefined (division by 0 or overflow)
+std::optional<int64_t> foldInteger(BinaryOp::OpType op, int64_t left, int64_t right) {
+  const unsigned bits = llvm::isIntN(32, left) && llvm::isIntN(32, right) ? 32 : 64;
+  const uint64_t a = static_cast<uint64_t>(left);
+  const uint64_t b = static_cast<uint64_t>(right);
+  uint64_t result = 0;
+  switch (op) {
+  case BinaryOp::ADD:
+    result = a + b;
+    break;
+  case BinaryOp::SUB:
+    result = a - b;
+    break;
+  case BinaryOp::MUL:
+    result = a * b;
+    break;
+  case BinaryOp::DIV:
+  case BinaryOp::MOD:
+    if (right == 0 || (left == llvm::minIntN(bits) && right == -1))
+      return std::nullopt;
+    return op == BinaryOp::DIV ? left / right : left % right;
+  case BinaryOp::BIT_AND:
+    result = a & b;
+    break;
+  case BinaryOp::BIT_OR:
+    result = a | b;
+    break;
+  case BinaryOp::BIT_XOR:
+    result = a ^ b;
+    break;
+  case BinaryOp::SHL:
+    result = a << (b & (bits - 1));
+    break;
+  case BinaryOp::SHR:
+    // Operands are sign extended to 64 bits, so this is the narrow shift too
+    return left >> (b & (bits - 1));
+  default:
+    return std::nullopt; // Comparisons and and/or give bools
+  }
+  return llvm::SignExtend64(result, bits);
+}
+} // namespace
+
 Parser::Parser(Lexer &lexer) : lexer(lexer) { tokens = lexer.tokenize(); }
 
 std::unique_ptr<Program> Parser::parse() {
@@ -33,6 +94,25 @@ std::unique_ptr<Program> Parser::parse() {
   return prog;
 }
 
+std::unique_ptr<Expression> Parser::parseSingleExpression() {
+  while (match({TokenType::COMMENT})) {
+  }
+
+  auto expr = parseExpression();
+
+  while (match({TokenType::COMMENT})) {
+  }
+
+  if (!isAtEnd()) {
+    std::stringstream stream;
+    stream << "Unexpected '" << peek().value << "' after expression at " << peek().location.line
+           << ":" << peek().location.column;
+    throw std::runtime_error(stream.str());
+  }
+
+  return expr;
+}
+
 void Parser::dumpAST(const Program &program) { program.dump(); }
 
 void Parser::printErrors() const {
@@ -153,6 +233,40 @@ std::unique_ptr<Type> Parser::parseType() {
   Token typeToken = advance(); // Consume token
   Type::TypeKind kind;
 
+  // [element]
+  if (typeToken.type == TokenType::LBRACKET) {
+    auto type = std::make_unique<Type>(Type::ARRAY, typeToken.location);
+    type->elementType = parseType();
+    consume(TokenType::RBRACKET, "Expected ']' after array element type");
+    return type;
+  }
+
+  // (type, type, ...)
+  if (typeToken.type == TokenType::LPAREN) {
+    auto type = std::make_unique<Type>(Type::TUPLE, typeToken.location);
+    do {
+      type->fieldTypes.push_back(parseType());
+    } while (match({TokenType::COMMA}));
+    consume(TokenType::RPAREN, "Expected ')' after tuple field types");
+    if (type->fieldTypes.size() < 2) {
+      throw std::runtime_error("Tuple types need at least two fields");
+    }
+    return type;
+  }
+
+  // {name: type, ...}
+  if (typeToken.type == TokenType::LBRACE) {
+    auto type = std::make_unique<Type>(Type::RECORD, typeToken.location);
+    do {
+      Token fieldName = consume(TokenType::IDENTIFIER, "Expected record field name");
+      consume(TokenType::COLON, "Expected ':' after record field name");
+      type->fieldNames.push_back(fieldName.value);
+      type->fieldTypes.push_back(parseType());
+    } while (match({TokenType::COMMA}));
+    consume(TokenType::RBRACE, "Expected '}' after record fields");
+    return type;
+  }
+
   switch (typeToken.type) {
   case TokenType::TYPE_INT:
     kind = Type::INT;
@@ -169,6 +283,33 @@ std::unique_ptr<Type> Parser::parseType() {
   case TokenType::TYPE_FUNC:
     kind = Type::FUNC;
     break;
+  case TokenType::TYPE_I8:
+    kind = Type::I8;
+    break;
+  case TokenType::TYPE_I16:
+    kind = Type::I16;
+    break;
+  case TokenType::TYPE_I64:
+    kind = Type::I64;
+    break;
+  case TokenType::TYPE_F64:
+    kind = Type::F64;
+    break;
+  case TokenType::TYPE_VEC4F:
+    kind = Type::VEC4F;
+    break;
+  case TokenType::TYPE_VEC8F:
+    kind = Type::VEC8F;
+    break;
+  case TokenType::TYPE_VEC4I:
+    kind = Type::VEC4I;
+    break;
+  case TokenType::TYPE_VEC8I:
+    kind = Type::VEC8I;
+    break;
+  case TokenType::TYPE_BOOL:
+    kind = Type::BOOL;
+    break;
   default:
     throw std::runtime_error("Expected type identifier");
   }
@@ -183,6 +324,22 @@ std::unique_ptr<Type> Parser::parseType() {
   return type;
 }
 
+std::unique_ptr<Expression> Parser::makeBinary(BinaryOp::OpType op,
+                                               std::unique_ptr<Expression> left,
+                                               std::unique_ptr<Expression> right,
+                                               const Location &loc) {
+  // Constant integer expressions become one literal, so they take the type
+  // they are used at like any literal
+  const auto *leftLit = dynamic_cast<const IntLiteral *>(left.get());
+  const auto *rightLit = dynamic_cast<const IntLiteral *>(right.get());
+  if (leftLit && rightLit) {
+    if (auto folded = foldInteger(op, leftLit->value, rightLit->value)) {
+      return std::make_unique<IntLiteral>(*folded, left->location);
+    }
+  }
+  return std::make_unique<BinaryOp>(op, std::move(left), std::move(right), loc);
+}
+
 std::vector<Parameter> Parser::parseParameters() {
   std::vector<Parameter> params;
 
@@ -206,7 +363,18 @@ std::unique_ptr<Expression> Parser::parseExpression() {
   if (match({TokenType::IF})) {
     return parseConditional();
   }
-  return parseComparison();
+  if (match({TokenType::LET})) {
+    return parseLet();
+  }
+  if (match({TokenType::MATCH})) {
+    return parseMatch();
+  }
+  return parseOr();
+}
+
+std::unique_ptr<Expression> Parser::parseEnclosed() {
+  FlagScope scope(pipeEndsArm, false);
+  return parseExpression();
 }
 
 std::unique_ptr<Expression> Parser::parseAddition() {
@@ -223,7 +391,7 @@ std::unique_ptr<Expression> Parser::parseAddition() {
       opType = BinaryOp::SUB;
     }
 
-    expr = std::make_unique<BinaryOp>(opType, std::move(expr), std::move(right), op.location);
+    expr = makeBinary(opType, std::move(expr), std::move(right), op.location);
   }
 
   return expr;
@@ -232,18 +400,20 @@ std::unique_ptr<Expression> Parser::parseAddition() {
 std::unique_ptr<Expression> Parser::parseMultiplication() {
   auto expr = parseUnary();
 
-  while (match({TokenType::MULTIPLY, TokenType::DIVIDE})) {
+  while (match({TokenType::MULTIPLY, TokenType::DIVIDE, TokenType::PERCENT})) {
     Token op = previous();
     auto right = parseUnary();
 
     BinaryOp::OpType opType;
     if (op.type == TokenType::MULTIPLY) {
       opType = BinaryOp::MUL;
-    } else {
+    } else if (op.type == TokenType::DIVIDE) {
       opType = BinaryOp::DIV;
+    } else {
+      opType = BinaryOp::MOD;
     }
 
-    expr = std::make_unique<BinaryOp>(opType, std::move(expr), std::move(right), op.location);
+    expr = makeBinary(opType, std::move(expr), std::move(right), op.location);
   }
 
   return expr;
@@ -253,9 +423,35 @@ std::unique_ptr<Expression> Parser::parseUnary() {
   if (match({TokenType::MINUS})) {
     Token op = previous();
     auto expr = parseUnary(); // Right-associative for multiple unary operators
+    const auto *literal = dynamic_cast<const IntLiteral *>(expr.get());
+    if (literal && literal->value != INT64_MIN) {
+      return std::make_unique<IntLiteral>(-literal->value, op.location);
+    }
     return std::make_unique<UnaryOp>(UnaryOp::NEG, std::move(expr), op.location);
   }
-  return parsePrimary();
+  return parsePostfix();
+}
+
+std::unique_ptr<Expression> Parser::parsePostfix() {
+  auto expr = parsePrimary();
+
+  // Indexing and field access, a[i].x[j] applies left to right
+  while (match({TokenType::LBRACKET, TokenType::DOT})) {
+    Token open = previous();
+    if (open.type == TokenType::DOT) {
+      if (!match({TokenType::IDENTIFIER, TokenType::INT_LITERAL})) {
+        consume(TokenType::IDENTIFIER, "Expected field name or index after '.'");
+      }
+      expr = std::make_unique<FieldAccess>(std::move(expr), previous().value, open.location);
+      continue;
+    }
+
+    auto index = parseEnclosed();
+    consume(TokenType::RBRACKET, "Expected ']' after index");
+    expr = std::make_unique<IndexExpression>(std::move(expr), std::move(index), open.location);
+  }
+
+  return expr;
 }
 
 std::unique_ptr<Expression> Parser::parsePrimary() {
@@ -265,15 +461,33 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
   }
 
   if (match({TokenType::INT_LITERAL})) {
-    int value = std::stoi(previous().value);
-    return std::make_unique<IntLiteral>(value, previous().location);
+    const Token &literal = previous();
+    int64_t value = 0;
+    auto [end, ec] = std::from_chars(literal.value.data(),
+                                     literal.value.data() + literal.value.size(), value);
+    if (ec != std::errc()) {
+      std::stringstream stream;
+      stream << "Integer literal " << literal.value << " doesn't fit in i64 at "
+             << literal.location.line << ":" << literal.location.column;
+      throw std::runtime_error(stream.str());
+    }
+    return std::make_unique<IntLiteral>(value, literal.location);
   }
 
   if (match({TokenType::FLOAT_LITERAL})) {
-    float value = std::stof(previous().value);
+    double value = std::stod(previous().value);
     return std::make_unique<FloatLiteral>(value, previous().location);
   }
 
+  if (match({TokenType::TRUE, TokenType::FALSE})) {
+    return std::make_unique<BoolLiteral>(previous().type == TokenType::TRUE, previous().location);
+  }
+
+  if (match({TokenType::CHAR_LITERAL})) {
+    return std::make_unique<IntLiteral>(static_cast<signed char>(previous().value[0]),
+                                        previous().location);
+  }
+
   // Handle identifiers (variable refs or func calls)
   if (match({TokenType::IDENTIFIER})) {
     auto identifier = std::make_unique<Identifier>(previous().value, previous().location);
@@ -286,11 +500,62 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
     return identifier;
   }
 
-  // Handle parenthesized exprs
+  // Handle array literals
+  if (match({TokenType::LBRACKET})) {
+    Token open = previous();
+    std::vector<std::unique_ptr<Expression>> elements;
+
+    if (!check(TokenType::RBRACKET)) {
+      do {
+        elements.push_back(parseEnclosed());
+      } while (match({TokenType::COMMA}));
+    }
+
+    consume(TokenType::RBRACKET, "Expected ']' after array elements");
+    return std::make_unique<ArrayLiteral>(std::move(elements), open.location);
+  }
+
+  // Handle record literals
+  if (match({TokenType::LBRACE})) {
+    Token open = previous();
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<Expression>> fields;
+
+    do {
+      names.push_back(consume(TokenType::IDENTIFIER, "Expected record field name").value);
+      consume(TokenType::COLON, "Expected ':' after record field name");
+      fields.push_back(parseEnclosed());
+    } while (match({TokenType::COMMA}));
+
+    consume(TokenType::RBRACE, "Expected '}' after record fields");
+    return std::make_unique<RecordLiteral>(std::move(names), std::move(fields), open.location);
+  }
+
+  // Handle parenthesized exprs and tuple literals
   if (match({TokenType::LPAREN})) {
-    auto expr = parseExpression();
-    consume(TokenType::RPAREN, "Expected ')' after expression");
-    return expr;
+    Token open = previous();
+    auto expr = parseEnclosed();
+    if (!check(TokenType::COMMA)) {
+      consume(TokenType::RPAREN, "Expected ')' after expression");
+      return expr;
+    }
+
+    std::vector<std::unique_ptr<Expression>> fields;
+    fields.push_back(std::move(expr));
+    while (match({TokenType::COMMA})) {
+      fields.push_back(parseEnclosed());
+    }
+
+    consume(TokenType::RPAREN, "Expected ')' after tuple fields");
+    return std::make_unique<RecordLiteral>(std::vector<std::string>(), std::move(fields),
+                                           open.location);
+  }
+
+  // Lexer errors are tokens carrying the message
+  if (check(TokenType::UNKNOWN)) {
+    std::stringstream stream;
+    stream << peek().value << " at " << peek().location.line << ":" << peek().location.column;
+    throw std::runtime_error(stream.str());
   }
 
   throw std::runtime_error("Expected expression");
@@ -305,7 +570,7 @@ std::unique_ptr<Expression> Parser::parseCall(std::unique_ptr<Expression> expr)
     // Parse args
     if (!check(TokenType::RPAREN)) {
       do {
-        arguments.push_back(parseExpression());
+        arguments.push_back(parseEnclosed());
       } while (match({TokenType::COMMA}));
     }
 
@@ -318,10 +583,14 @@ std::unique_ptr<Expression> Parser::parseCall(std::unique_ptr<Expression> expr)
 }
 
 std::unique_ptr<Expression> Parser::parseConditional() {
-  auto condition = parseComparison();
-
-  consume(TokenType::THEN, "Expected 'then' after if condition");
-  auto thenExpr = parseExpression();
+  std::unique_ptr<Expression> condition, thenExpr;
+  {
+    // Both end at a keyword, so `|` can't start a match arm
+    FlagScope scope(pipeEndsArm, false);
+    condition = parseOr();
+    consume(TokenType::THEN, "Expected 'then' after if condition");
+    thenExpr = parseExpression();
+  }
 
   consume(TokenType::ELSE, "Expected 'else' after then expression");
   auto elseExpr = parseExpression();
@@ -330,13 +599,139 @@ std::unique_ptr<Expression> Parser::parseConditional() {
                                                  std::move(elseExpr), condition->location);
 }
 
+std::unique_ptr<Expression> Parser::parseLet() {
+  const Location loc = previous().location;
+
+  // let name = ... or let (a, b, ...) = ...
+  std::vector<std::string> names;
+  const bool destructure = match({TokenType::LPAREN});
+  if (destructure) {
+    do {
+      names.push_back(consume(TokenType::IDENTIFIER, "Expected name in let pattern").value);
+    } while (match({TokenType::COMMA}));
+    consume(TokenType::RPAREN, "Expected ')' after let pattern");
+  } else {
+    names.push_back(consume(TokenType::IDENTIFIER, "Expected name after 'let'").value);
+  }
+
+  consume(TokenType::EQUALS, "Expected '=' after let name");
+  auto value = parseEnclosed();
+
+  consume(TokenType::IN, "Expected 'in' after let value");
+  auto body = parseExpression();
+
+  return std::make_unique<LetExpression>(std::move(names), destructure, std::move(value),
+                                         std::move(body), loc);
+}
+
+std::unique_ptr<Expression> Parser::parseMatch() {
+  const Location loc = previous().location;
+  auto subject = parseEnclosed();
+  consume(TokenType::WITH, "Expected 'with' after match subject");
+
+  // Arms until the `_` one, a nested match in an arm ends at its own `_`
+  std::vector<MatchArm> arms;
+  while (arms.empty() || !arms.back().patterns.empty()) {
+    const Location armLoc = consume(TokenType::PIPE, "Expected '|' before match arm").location;
+
+    std::vector<std::unique_ptr<Expression>> patterns;
+    bool wildcard = false;
+    do {
+      if (check(TokenType::IDENTIFIER) && peek().value == "_") {
+        advance();
+        wildcard = true;
+      } else {
+        patterns.push_back(parsePattern());
+      }
+    } while (match({TokenType::PIPE}));
+
+    if (wildcard && !patterns.empty()) {
+      std::stringstream stream;
+      stream << "'_' can't be combined with other patterns at " << armLoc.line << ":"
+             << armLoc.column;
+      throw std::runtime_error(stream.str());
+    }
+
+    consume(TokenType::ARROW, "Expected '->' after match pattern");
+    std::unique_ptr<Expression> body;
+    {
+      FlagScope scope(pipeEndsArm, true);
+      body = parseExpression();
+    }
+    arms.emplace_back(std::move(patterns), std::move(body), armLoc);
+
+    if (!wildcard && !check(TokenType::PIPE)) {
+      std::stringstream stream;
+      stream << "match needs a final '_' arm at " << peek().location.line << ":"
+             << peek().location.column;
+      throw std::runtime_error(stream.str());
+    }
+  }
+
+  return std::make_unique<MatchExpression>(std::move(subject), std::move(arms), loc);
+}
+
+std::unique_ptr<Expression> Parser::parsePattern() {
+  if (check(TokenType::STRING_LITERAL) || check(TokenType::CHAR_LITERAL) ||
+      check(TokenType::INT_LITERAL)) {
+    return parsePrimary();
+  }
+
+  // Negative numbers are a single literal
+  if (check(TokenType::MINUS) && tokens[current + 1].type == TokenType::INT_LITERAL) {
+    const Location loc = advance().location;
+    auto literal = parsePrimary();
+    return std::make_unique<IntLiteral>(-static_cast<IntLiteral &>(*literal).value, loc);
+  }
+
+  std::stringstream stream;
+  stream << "Expected an int, char or string literal or '_' as pattern at "
+         << peek().location.line << ":" << peek().location.column;
+  throw std::runtime_error(stream.str());
+}
+
+std::unique_ptr<Expression> Parser::parseOr() {
+  auto expr = parseAnd();
+
+  while (match({TokenType::OR})) {
+    Token op = previous();
+    auto right = parseAnd();
+    expr = std::make_unique<BinaryOp>(BinaryOp::OR, std::move(expr), std::move(right), op.location);
+  }
+
+  return expr;
+}
+
+std::unique_ptr<Expression> Parser::parseAnd() {
+  auto expr = parseNot();
+
+  while (match({TokenType::AND})) {
+    Token op = previous();
+    auto right = parseNot();
+    expr =
+        std::make_unique<BinaryOp>(BinaryOp::AND, std::move(expr), std::move(right), op.location);
+  }
+
+  return expr;
+}
+
+// Below and/or, above comparisons: not a == b is not (a == b)
+std::unique_ptr<Expression> Parser::parseNot() {
+  if (match({TokenType::NOT})) {
+    Token op = previous();
+    auto expr = parseNot();
+    return std::make_unique<UnaryOp>(UnaryOp::NOT, std::move(expr), op.location);
+  }
+  return parseComparison();
+}
+
 std::unique_ptr<Expression> Parser::parseComparison() {
-  auto expr = parseAddition();
+  auto expr = parseBitOr();
 
   while (match({TokenType::LESS_THAN, TokenType::GREATER_THAN, TokenType::LESS_EQUAL,
                 TokenType::GREATER_EQUAL, TokenType::EQUAL_EQUAL, TokenType::NOT_EQUAL})) {
     Token op = previous();
-    auto right = parseAddition();
+    auto right = parseBitOr();
 
     BinaryOp::OpType opType;
     switch (op.type) {
@@ -368,4 +763,56 @@ std::unique_ptr<Expression> Parser::parseComparison() {
   return expr;
 }
 
+// Bitwise operators bind tighter than comparisons, x & 1 == 0 is
+// (x & 1) == 0
+std::unique_ptr<Expression> Parser::parseBitOr() {
+  auto expr = parseBitXor();
+
+  // In a match arm `|` starts the next arm
+  while (!pipeEndsArm && match({TokenType::PIPE})) {
+    Token op = previous();
+    auto right = parseBitXor();
+    expr = makeBinary(BinaryOp::BIT_OR, std::move(expr), std::move(right), op.location);
+  }
+
+  return expr;
+}
+
+std::unique_ptr<Expression> Parser::parseBitXor() {
+  auto expr = parseBitAnd();
+
+  while (match({TokenType::CARET})) {
+    Token op = previous();
+    auto right = parseBitAnd();
+    expr = makeBinary(BinaryOp::BIT_XOR, std::move(expr), std::move(right), op.location);
+  }
+
+  return expr;
+}
+
+std::unique_ptr<Expression> Parser::parseBitAnd() {
+  auto expr = parseShift();
+
+  while (match({TokenType::AMPERSAND})) {
+    Token op = previous();
+    auto right = parseShift();
+    expr = makeBinary(BinaryOp::BIT_AND, std::move(expr), std::move(right), op.location);
+  }
+
+  return expr;
+}
+
+std::unique_ptr<Expression> Parser::parseShift() {
+  auto expr = parseAddition();
+
+  while (match({TokenType::SHIFT_LEFT, TokenType::SHIFT_RIGHT})) {
+    Token op = previous();
+    auto right = parseAddition();
+    const auto opType = op.type == TokenType::SHIFT_LEFT ? BinaryOp::SHL : BinaryOp::SHR;
+    expr = makeBinary(opType, std::move(expr), std::move(right), op.location);
+  }
+
+  return expr;
+}
+
 } // namespace lge
@@ -0,0 +1,173 @@
+#include "purity.h"
+
+namespace lge {
+
+namespace {
+// Builtins observable outside the program
+const std::unordered_set<std::string> effectfulBuiltins = {"str_print", "str_read"};
+
+// Everything a function body may call, false if it calls through a function
+// value
+class ReferenceCollector {
+public:
+  std::unordered_set<std::string> references;
+
+  explicit ReferenceCollector(const FunctionDef &func) {
+    for (const auto &param : func.parameters) {
+      parameters.insert(param.name);
+    }
+  }
+
+  bool collect(const Expression &expr) {
+    if (dynamic_cast<const IntLiteral *>(&expr) || dynamic_cast<const FloatLiteral *>(&expr) ||
+        dynamic_cast<const StringLiteral *>(&expr) || dynamic_cast<const BoolLiteral *>(&expr)) {
+      return true;
+    }
+
+    // A function passed by name (map(f, xs)) is assumed to be called
+    if (const auto *ident = dynamic_cast<const Identifier *>(&expr)) {
+      if (!parameters.contains(ident->name)) {
+        references.insert(ident->name);
+      }
+      return true;
+    }
+
+    if (const auto *unaryOp = dynamic_cast<const UnaryOp *>(&expr)) {
+      return collect(*unaryOp->operand);
+    }
+    if (const auto *binOp = dynamic_cast<const BinaryOp *>(&expr)) {
+      return collect(*binOp->left) && collect(*binOp->right);
+    }
+
+    if (const auto *call = dynamic_cast<const FunctionCall *>(&expr)) {
+      if (parameters.contains(call->funcName)) {
+        return false;
+      }
+      references.insert(call->funcName);
+
+      for (const auto &arg : call->args) {
+        if (!collect(*arg))
+          return false;
+      }
+      return true;
+    }
+
+    if (const auto *condExpr = dynamic_cast<const ConditionalExpression *>(&expr)) {
+      return collect(*condExpr->condition) && collect(*condExpr->thenExpr) &&
+             collect(*condExpr->elseExpr);
+    }
+
+    if (const auto *arrayLit = dynamic_cast<const ArrayLiteral *>(&expr)) {
+      for (const auto &element : arrayLit->elements) {
+        if (!collect(*element))
+          return false;
+      }
+      return true;
+    }
+    if (const auto *indexExpr = dynamic_cast<const IndexExpression *>(&expr)) {
+      return collect(*indexExpr->array) && collect(*indexExpr->index);
+    }
+
+    if (const auto *recordLit = dynamic_cast<const RecordLiteral *>(&expr)) {
+      for (const auto &field : recordLit->fields) {
+        if (!collect(*field))
+          return false;
+      }
+      return true;
+    }
+    if (const auto *fieldAccess = dynamic_cast<const FieldAccess *>(&expr)) {
+      return collect(*fieldAccess->record);
+    }
+
+    // Let bound names are local values like parameters, within the body
+    if (const auto *letExpr = dynamic_cast<const LetExpression *>(&expr)) {
+      if (!collect(*letExpr->value))
+        return false;
+
+      std::vector<std::string> bound;
+      for (const auto &name : letExpr->names) {
+        if (parameters.insert(name).second) {
+          bound.push_back(name);
+        }
+      }
+      const bool result = collect(*letExpr->body);
+      for (const auto &name : bound) {
+        parameters.erase(name);
+      }
+      return result;
+    }
+
+    // Patterns are literals
+    if (const auto *matchExpr = dynamic_cast<const MatchExpression *>(&expr)) {
+      if (!collect(*matchExpr->subject))
+        return false;
+      for (const auto &arm : matchExpr->arms) {
+        if (!collect(*arm.body))
+          return false;
+      }
+      return true;
+    }
+
+    // Unknown nodes are never assumed to be pure
+    return false;
+  }
+
+private:
+  std::unordered_set<std::string> parameters;
+};
+} // namespace
+
+PurityAnalysis::PurityAnalysis(const Program &program) {
+  // First definition of every name, what references resolve to
+  std::unordered_map<std::string, const FunctionDef *> definitions;
+  for (const auto &func : program.functions) {
+    definitions.emplace(func->name, func.get());
+  }
+
+  // Everything without indirect calls starts out pure, then impurity flows
+  // from each impure function to the functions referencing it, so every
+  // reference is followed once
+  std::unordered_map<std::string, std::vector<std::string>> referencedBy;
+  std::vector<std::string> worklist;
+  for (const auto &[name, func] : definitions) {
+    ReferenceCollector collector(*func);
+    if (!collector.collect(*func->body)) {
+      worklist.push_back(name);
+      continue;
+    }
+
+    // Definitions shadow builtins, builtins other than I/O are pure
+    bool callsImpure = false;
+    for (const auto &reference : collector.references) {
+      if (definitions.contains(reference)) {
+        referencedBy[reference].push_back(name);
+      } else if (effectfulBuiltins.contains(reference)) {
+        callsImpure = true;
+      }
+    }
+
+    if (callsImpure) {
+      worklist.push_back(name);
+    } else {
+      pure.insert(name);
+    }
+  }
+
+  while (!worklist.empty()) {
+    std::string name = std::move(worklist.back());
+    worklist.pop_back();
+
+    auto it = referencedBy.find(name);
+    if (it == referencedBy.end())
+      continue;
+    for (const auto &caller : it->second) {
+      if (pure.erase(caller)) {
+        worklist.push_back(caller);
+      }
+    }
+  }
+}
+
+bool PurityAnalysis::isPure(const std::string &name) const { return pure.contains(name); }
+
+} // namespace lge
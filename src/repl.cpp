@@ -0,0 +1,179 @@
+#include "repl.h"
+
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+
+#include "backend.h"
+#include "codegen.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parser.h"
+
+namespace lge {
+
+namespace {
+class ReplSession {
+public:
+  ReplSession(const std::vector<std::string> &libraries, unsigned optLevel,
+              const CodeGenOptions &options)
+      : jit(createJIT(libraries, optLevel == 0)), optLevel(optLevel), options(options),
+        program(Location()) {}
+
+  // Compiles the functions into a module of their own and keeps them, false
+  // (with errors reported) if they don't compile
+  bool define(const std::vector<FuncDefPtr> &functions) {
+    // Earlier definitions are only declared, their code is already in the JIT
+    Program candidate{Location()};
+    candidate.functions = program.functions;
+    candidate.functions.insert(candidate.functions.end(), functions.begin(), functions.end());
+
+    std::vector<const FunctionDef *> bodies;
+    for (const auto &func : functions) {
+      bodies.push_back(func.get());
+    }
+
+    const PurityAnalysis purity(candidate);
+    const CostModel costModel = options.autoParallel ? CostModel(candidate) : CostModel();
+    CodeGenerator codegen(options);
+    codegen.generate(candidate, bodies, purity, costModel);
+    if (codegen.hasErrors() || !codegen.verify()) {
+      return false;
+    }
+
+    addModule(codegen, nullptr);
+    program.functions = std::move(candidate.functions);
+    return true;
+  }
+
+  // One complete input, a definition or an expression
+  void evaluate(const std::string &input) {
+    const std::string filename = "<repl:" + std::to_string(++inputCount) + ">";
+
+    // Definitions start with `let name:`, `let x = ... in` is an expression.
+    // Comments and blank input are skipped.
+    Lexer probe(input, filename);
+    std::vector<TokenType> leading;
+    while (leading.size() < 3) {
+      Token token = probe.nextToken();
+      if (token.type == TokenType::COMMENT)
+        continue;
+      leading.push_back(token.type);
+      if (token.type == TokenType::EOF_TOKEN)
+        break;
+    }
+    if (leading.front() == TokenType::EOF_TOKEN) {
+      return;
+    }
+
+    Lexer lexer(input, filename);
+    Parser parser(lexer);
+
+    const bool definition = leading.size() == 3 && leading[0] == TokenType::LET &&
+                            leading[1] == TokenType::IDENTIFIER && leading[2] == TokenType::COLON;
+    if (definition) {
+      auto parsed = parser.parse();
+      if (parser.hasErrors()) {
+        parser.printErrors();
+        return;
+      }
+      define(parsed->functions);
+      return;
+    }
+
+    auto expr = parser.parseSingleExpression();
+
+    const std::string name = "__repl_" + std::to_string(inputCount);
+    CodeGenerator codegen(options);
+    codegen.generateEvaluation(program, name, *expr);
+    if (codegen.hasErrors() || !codegen.verify()) {
+      return;
+    }
+
+    // The evaluation is only needed once, its code is freed right after
+    auto tracker = jit->getMainJITDylib().createResourceTracker();
+    addModule(codegen, tracker);
+
+    auto symbol = jit->lookup(name);
+    if (!symbol) {
+      throw std::runtime_error(llvm::toString(symbol.takeError()));
+    }
+    symbol->toPtr<void (*)()>()();
+    std::fflush(stdout);
+
+    if (auto error = tracker->remove()) {
+      throw std::runtime_error(llvm::toString(std::move(error)));
+    }
+  }
+
+private:
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  unsigned optLevel;
+  CodeGenOptions options;
+  Program program; // Everything defined so far
+  size_t inputCount = 0;
+
+  void addModule(CodeGenerator &codegen, llvm::orc::ResourceTrackerSP tracker) {
+    // The module must not outlive its context
+    auto module = codegen.takeModule();
+    auto context = codegen.takeContext();
+
+    module->setDataLayout(jit->getDataLayout());
+    optimizeModule(*module, optLevel);
+
+    llvm::orc::ThreadSafeModule threadSafeModule(std::move(module), std::move(context));
+    auto error = tracker ? jit->addIRModule(tracker, std::move(threadSafeModule))
+                         : jit->addIRModule(std::move(threadSafeModule));
+    if (error) {
+      throw std::runtime_error(llvm::toString(std::move(error)));
+    }
+  }
+};
+} // namespace
+
+int runRepl(const Program &prelude, const std::vector<std::string> &libraries, unsigned optLevel,
+            const CodeGenOptions &options) {
+  ReplSession session(libraries, optLevel, options);
+  if (!prelude.functions.empty() && !session.define(prelude.functions)) {
+    return 1;
+  }
+
+  // Prompts only for a terminal, piped sessions print just the results
+  const bool interactive = isatty(STDIN_FILENO);
+
+  std::string input, line;
+  while (true) {
+    if (interactive) {
+      std::cout << (input.empty() ? "> " : ". ") << std::flush;
+    }
+    if (!std::getline(std::cin, line)) {
+      break;
+    }
+
+    if (!line.empty() && line.back() == '\\') {
+      line.pop_back();
+      input += line + "\n";
+      continue;
+    }
+    input += line;
+
+    try {
+      session.evaluate(input);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+    }
+    input.clear();
+  }
+
+  if (interactive) {
+    std::cout << std::endl;
+  }
+  return 0;
+}
+
+} // namespace lge
@@ -0,0 +1,312 @@
+#include "server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <stdio_ext.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "driver.h"
+#include "frontend.h"
+
+namespace lge {
+
+namespace {
+constexpr int stdioCount = 3; // stdin, stdout and stderr are forwarded
+
+sockaddr_un socketAddress(const std::string &path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + path);
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+bool readAll(int fd, void *data, size_t size) {
+  auto *bytes = static_cast<char *>(data);
+  while (size > 0) {
+    const ssize_t count = read(fd, bytes, size);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      return false;
+    bytes += count;
+    size -= count;
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void *data, size_t size) {
+  const auto *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    const ssize_t count = write(fd, bytes, size);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      return false;
+    bytes += count;
+    size -= count;
+  }
+  return true;
+}
+
+// A request is the payload size, sent along with the client's stdio
+// descriptors, followed by the payload: the working directory and the
+// arguments, each NUL terminated
+bool sendRequest(int sock, const std::string &payload) {
+  uint32_t size = payload.size();
+  iovec iov{&size, sizeof(size)};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * stdioCount)] = {};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  cmsghdr *header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(int) * stdioCount);
+  const int fds[stdioCount] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+  if (sendmsg(sock, &message, 0) != sizeof(size))
+    return false;
+  return writeAll(sock, payload.data(), payload.size());
+}
+
+bool receiveRequest(int sock, std::string &payload, int (&fds)[stdioCount]) {
+  uint32_t size = 0;
+  iovec iov{&size, sizeof(size)};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * stdioCount)] = {};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  if (recvmsg(sock, &message, MSG_CMSG_CLOEXEC) != sizeof(size))
+    return false;
+
+  cmsghdr *header = CMSG_FIRSTHDR(&message);
+  if (!header || header->cmsg_type != SCM_RIGHTS ||
+      header->cmsg_len != CMSG_LEN(sizeof(int) * stdioCount)) {
+    return false;
+  }
+  std::memcpy(fds, CMSG_DATA(header), sizeof(fds));
+
+  payload.resize(size);
+  if (!readAll(sock, payload.data(), size)) {
+    for (int fd : fds) {
+      close(fd);
+    }
+    return false;
+  }
+  return true;
+}
+
+void flushOutput() {
+  std::cout.flush();
+  std::cerr.flush();
+  llvm::outs().flush();
+  std::fflush(nullptr);
+}
+
+// Working directory followed by the arguments
+std::vector<std::string> splitPayload(const std::string &payload) {
+  std::vector<std::string> parts;
+  for (size_t start = 0; start < payload.size();) {
+    const size_t end = payload.find('\0', start);
+    if (end == std::string::npos)
+      break;
+    parts.push_back(payload.substr(start, end - start));
+    start = end + 1;
+  }
+  return parts;
+}
+
+// --run and --repl execute the client's program, which may crash or never
+// return
+bool runsUserCode(const std::vector<std::string> &parts) {
+  for (size_t i = 1; i < parts.size(); i++) {
+    if (parts[i] == "--run" || parts[i] == "--repl")
+      return true;
+  }
+  return false;
+}
+
+// Runs one compilation with the client's stdio and working directory
+int runRequest(const std::vector<std::string> &parts, const int (&fds)[stdioCount],
+               ASTCache &astCache) {
+  if (parts.empty())
+    return 1;
+
+  // parts[0] is the working directory, the program name takes its place
+  std::vector<const char *> argv{"lgec"};
+  for (size_t i = 1; i < parts.size(); i++) {
+    argv.push_back(parts[i].c_str());
+  }
+
+  llvm::SmallString<256> serverDirectory;
+  llvm::sys::fs::current_path(serverDirectory);
+
+  int saved[stdioCount];
+  flushOutput();
+  __fpurge(stdin);
+  for (int i = 0; i < stdioCount; i++) {
+    saved[i] = dup(i);
+    dup2(fds[i], i);
+  }
+
+  int exitCode = 1;
+  if (llvm::sys::fs::set_current_path(parts[0])) {
+    std::cerr << "Error: Could not change to directory " << parts[0] << std::endl;
+  } else {
+    try {
+      exitCode = runCompiler(static_cast<int>(argv.size()), argv.data(), &astCache);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+    }
+  }
+
+  // Nothing buffered for this client may reach the next one
+  flushOutput();
+  __fpurge(stdin);
+  std::clearerr(stdin);
+  std::clearerr(stdout);
+  std::cin.clear();
+  std::cout.clear();
+  std::cerr.clear();
+  for (int i = 0; i < stdioCount; i++) {
+    dup2(saved[i], i);
+    close(saved[i]);
+  }
+  llvm::sys::fs::set_current_path(serverDirectory);
+
+  return exitCode;
+}
+} // namespace
+
+int serve(const std::string &socketPath) {
+  // A client going away mid request must not take the server with it
+  std::signal(SIGPIPE, SIG_IGN);
+  // Children running user code are reaped by the kernel
+  std::signal(SIGCHLD, SIG_IGN);
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+
+  const sockaddr_un address = socketAddress(socketPath);
+  const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0) {
+    std::cerr << "Error: Could not create socket: " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+
+  // Left behind by a server that was killed
+  unlink(socketPath.c_str());
+
+  if (bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) ||
+      listen(listener, SOMAXCONN)) {
+    std::cerr << "Error: Could not listen on " << socketPath << ": " << std::strerror(errno)
+              << std::endl;
+    close(listener);
+    return 1;
+  }
+
+  ASTCache astCache;
+
+  // Compilations are served one at a time, they share the process' stdio
+  while (true) {
+    const int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "Error: accept failed: " << std::strerror(errno) << std::endl;
+      break;
+    }
+
+    std::string payload;
+    int fds[stdioCount];
+    if (receiveRequest(client, payload, fds)) {
+      const std::vector<std::string> parts = splitPayload(payload);
+
+      if (!runsUserCode(parts)) {
+        const int32_t exitCode = runRequest(parts, fds, astCache);
+        writeAll(client, &exitCode, sizeof(exitCode));
+      } else if (const pid_t child = fork(); child == 0) {
+        // User code runs in a child answering the client itself, so a crash
+        // or an endless loop doesn't take the server down or hold up other
+        // requests. ASTs parsed by the child aren't kept.
+        close(listener);
+        const int32_t exitCode = runRequest(parts, fds, astCache);
+        writeAll(client, &exitCode, sizeof(exitCode));
+        _exit(exitCode);
+      } else if (child < 0) {
+        const std::string message =
+            "Error: Could not fork: " + std::string(std::strerror(errno)) + "\n";
+        writeAll(fds[STDERR_FILENO], message.data(), message.size());
+        const int32_t exitCode = 1;
+        writeAll(client, &exitCode, sizeof(exitCode));
+      }
+      for (int fd : fds) {
+        close(fd);
+      }
+    }
+    close(client);
+  }
+
+  close(listener);
+  return 1;
+}
+
+int connectAndRun(const std::string &socketPath, const std::vector<std::string> &args) {
+  const sockaddr_un address = socketAddress(socketPath);
+  const int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0 || connect(sock, reinterpret_cast<const sockaddr *>(&address), sizeof(address))) {
+    std::cerr << "Error: Could not connect to compile server at " << socketPath << ": "
+              << std::strerror(errno) << std::endl;
+    if (sock >= 0)
+      close(sock);
+    return 1;
+  }
+
+  llvm::SmallString<256> directory;
+  llvm::sys::fs::current_path(directory);
+
+  std::string payload(directory.str());
+  payload += '\0';
+  for (const auto &arg : args) {
+    payload += arg;
+    payload += '\0';
+  }
+
+  int32_t exitCode = 1;
+  if (!sendRequest(sock, payload) || !readAll(sock, &exitCode, sizeof(exitCode))) {
+    std::cerr << "Error: Compile server at " << socketPath << " did not answer" << std::endl;
+    exitCode = 1;
+  }
+
+  close(sock);
+  return exitCode;
+}
+
+} // namespace lge
@@ -0,0 +1,172 @@
+#include "sharding.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SmallVectorMemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "backend.h"
+#include "codegen.h"
+#include "optimizer.h"
+#include "parallel.h"
+
+namespace lge {
+
+ShardedCompiler::ShardedCompiler(const Program &program, unsigned shardCount,
+                                 FunctionCache *cache)
+    : program(program), cache(cache), threadCount(std::max(1u, shardCount)) {
+  // Target registration isn't thread safe, do it before any shard needs it
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  if (cache) {
+    shards.resize(program.functions.size());
+    for (size_t i = 0; i < program.functions.size(); i++) {
+      shards[i].functions.push_back(program.functions[i].get());
+    }
+    return;
+  }
+
+  // Round robin keeps neighbouring (often similarly sized) functions apart
+  const size_t count = std::max<size_t>(1, std::min<size_t>(shardCount, program.functions.size()));
+  shards.resize(count);
+  for (size_t i = 0; i < program.functions.size(); i++) {
+    shards[i % count].functions.push_back(program.functions[i].get());
+  }
+}
+
+bool ShardedCompiler::compile(unsigned optLevel, const CodeGenOptions &options) {
+  // First definition of every name, what references resolve to.
+  // Duplicates are reported here, a cached shard never reaches the code
+  // generator that would report them.
+  std::unordered_map<std::string, const FunctionDef *> definitions;
+  bool duplicates = false;
+  for (const auto &func : program.functions) {
+    auto [previous, inserted] = definitions.emplace(func->name, func.get());
+    if (inserted)
+      continue;
+
+    const Location &loc = func->location, &previousLoc = previous->second->location;
+    std::cerr << "Code generation error at " << loc.filename << ":" << loc.line << ":"
+              << loc.column << ": Duplicate definition of function: " << func->name
+              << " (previously defined at " << previousLoc.filename << ":" << previousLoc.line
+              << ":" << previousLoc.column << ")" << std::endl;
+    duplicates = true;
+  }
+  if (duplicates)
+    return false;
+
+  // Whole-program analyses, computed once and only read by the shards' threads
+  const PurityAnalysis purity(program);
+  const CostModel costModel = options.autoParallel ? CostModel(program) : CostModel();
+
+  parallelFor(shards.size(), threadCount, [&](size_t i) {
+    Shard &shard = shards[i];
+
+    std::string key;
+    if (cache) {
+      key = cache->key(*shard.functions.front(), definitions, purity, costModel, optLevel,
+                       options);
+      if ((shard.bitcode = cache->lookup(key)))
+        return;
+    }
+
+    CodeGenerator codegen(options);
+    codegen.generate(program, shard.functions, purity, costModel);
+    shard.hadErrors = codegen.hasErrors() || !codegen.verify();
+    if (shard.hadErrors)
+      return;
+
+    optimizeModule(codegen.getModule(), optLevel);
+
+    shard.module = codegen.takeModule();
+    shard.context = codegen.takeContext();
+
+    if (cache) {
+      serialize(shard);
+      cache->store(key, llvm::ArrayRef<char>(shard.bitcode->getBufferStart(),
+                                             shard.bitcode->getBufferSize()));
+
+      // Only the bitcode is needed from here on
+      shard.module.reset();
+      shard.context.reset();
+    }
+  });
+
+  if (cache) {
+    cache->prune();
+  }
+
+  for (const auto &shard : shards) {
+    if (shard.hadErrors)
+      return false;
+  }
+  return true;
+}
+
+void ShardedCompiler::serialize(Shard &shard) {
+  llvm::SmallVector<char, 0> buffer;
+  llvm::raw_svector_ostream out(buffer);
+  llvm::WriteBitcodeToFile(*shard.module, out);
+  shard.bitcode = std::make_unique<llvm::SmallVectorMemoryBuffer>(std::move(buffer));
+}
+
+std::unique_ptr<llvm::Module> ShardedCompiler::link(llvm::LLVMContext &context) {
+  // Modules can't move between contexts, serialize them in parallel first
+  parallelFor(shards.size(), threadCount, [&](size_t i) {
+    if (!shards[i].bitcode) {
+      serialize(shards[i]);
+    }
+  });
+
+  auto linked = std::make_unique<llvm::Module>("LGE Module", context);
+
+  // One linker for all shards, it indexes the destination module only once
+  llvm::Linker linker(*linked);
+  for (size_t i = 0; i < shards.size(); i++) {
+    auto module = llvm::parseBitcodeFile(shards[i].bitcode->getMemBufferRef(), context);
+    if (!module) {
+      throw std::runtime_error("Failed to read shard " + std::to_string(i) + ": " +
+                               llvm::toString(module.takeError()));
+    }
+
+    if (linker.linkInModule(std::move(*module))) {
+      throw std::runtime_error("Failed to link shard " + std::to_string(i));
+    }
+  }
+
+  return linked;
+}
+
+std::vector<std::string> ShardedCompiler::emitObjects(const std::string &base) {
+  if (base.empty() || base == "-") {
+    throw std::runtime_error("Objects of a sharded build need an output file name");
+  }
+  if (cache) {
+    throw std::runtime_error("Objects can't be emitted per shard when using the function cache");
+  }
+
+  // app.o => app.0.o, app.1.o, ...
+  const std::string stem = base.ends_with(".o") ? base.substr(0, base.size() - 2) : base;
+
+  std::vector<std::string> paths(shards.size());
+  for (size_t i = 0; i < shards.size(); i++) {
+    paths[i] = stem + "." + std::to_string(i) + ".o";
+  }
+
+  parallelFor(shards.size(), threadCount,
+              [&](size_t i) { emitModule(*shards[i].module, EmitKind::OBJECT, paths[i]); });
+
+  return paths;
+}
+
+} // namespace lge
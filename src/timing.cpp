@@ -0,0 +1,85 @@
+#include "timing.h"
+
+#include <iomanip>
+
+#include <sys/resource.h>
+#include <time.h>
+
+namespace {
+
+// User + system time of the process so far, phases record the difference
+// so they only count their own work
+double cpuTimeMs() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+long peakRssKb() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+} // namespace
+
+namespace lge {
+
+ThreadTime ThreadTime::now() {
+  const std::chrono::duration<double, std::milli> wall =
+      std::chrono::steady_clock::now().time_since_epoch();
+  timespec cpu{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+  return {wall.count(), cpu.tv_sec * 1000.0 + cpu.tv_nsec / 1e6};
+}
+
+PhaseTimer::Scope::Scope(PhaseTimer &timer, const std::string &name)
+    : timer(timer), name(name), wallStart(std::chrono::steady_clock::now()),
+      cpuStart(cpuTimeMs()), traceScope(name) {}
+
+PhaseTimer::Scope::~Scope() {
+  const std::chrono::duration<double, std::milli> wall =
+      std::chrono::steady_clock::now() - wallStart;
+  timer.phases.push_back({name, wall.count(), cpuTimeMs() - cpuStart, peakRssKb()});
+}
+
+void PhaseTimer::record(const std::string &name, const ThreadTime &time) {
+  phases.push_back({name, time.wallMs, time.cpuMs, peakRssKb()});
+}
+
+void PhaseTimer::report(std::ostream &os) const {
+  double totalWall = 0, totalCpu = 0;
+
+  os << "===" << std::string(57, '-') << "===" << std::endl;
+  os << "                    LGE compile time report" << std::endl;
+  os << "===" << std::string(57, '-') << "===" << std::endl;
+  os << std::left << std::setw(24) << "  Phase" << std::right << std::setw(12) << "Wall (ms)"
+     << std::setw(12) << "CPU (ms)";
+  if (reportPeakRss) {
+    os << std::setw(15) << "Peak RSS (MB)";
+  }
+  os << std::endl;
+
+  os << std::fixed << std::setprecision(3);
+  for (const auto &phase : phases) {
+    os << "  " << std::left << std::setw(22) << phase.name << std::right << std::setw(12)
+       << phase.wallMs << std::setw(12) << phase.cpuMs;
+    if (reportPeakRss) {
+      os << std::setw(15) << phase.peakRssKb / 1024.0;
+    }
+    os << std::endl;
+    totalWall += phase.wallMs;
+    totalCpu += phase.cpuMs;
+  }
+
+  os << "  " << std::left << std::setw(22) << "Total" << std::right << std::setw(12) << totalWall
+     << std::setw(12) << totalCpu;
+  if (reportPeakRss) {
+    os << std::setw(15) << peakRssKb() / 1024.0;
+  }
+  os << std::endl;
+  os << std::defaultfloat;
+}
+
+} // namespace lge
@@ -1,12 +1,23 @@
 #! /usr/bin/python3
 
 import argparse
+from concurrent.futures import ThreadPoolExecutor, as_completed
 from dataclasses import dataclass
+import hashlib
 import json
 import os
+import re
+import shutil
 import subprocess
+import sys
+import tempfile
+import threading
 import time
-from typing import List, TypedDict
+from typing import Dict, List, NotRequired, TypedDict
+
+
+# Shard count of the sharded variants of multi-function examples
+SHARDS = 4
 
 
 class TestType(TypedDict):
@@ -14,6 +25,8 @@ class TestType(TypedDict):
     file_name: str
     exit_code: int
     has_stdin: bool
+    compiler_args: NotRequired[List[str]]
+    repl: NotRequired[bool]  # Stdin is read by --repl, the example holds its first definitions
 
 
 class JsonType(TypedDict):
@@ -28,19 +41,370 @@ class CmdRunRet:
     stderr: str
 
 
-def run_command(cmd: str) -> CmdRunRet:
+@dataclass
+class TestResult:
+    test: TestType
+    duration: float
+    error: str | None
+
+
+def run_command(cmd: List[str], stdin_path: str | None = None) -> CmdRunRet:
+    stdin = open(stdin_path, 'r', encoding="utf-8") if stdin_path else subprocess.DEVNULL
     try:
         result = subprocess.run(
             cmd,
-            shell=True,
-            check=True,
+            stdin=stdin,
             text=True,
             stdout=subprocess.PIPE,
             stderr=subprocess.PIPE
         )
         return CmdRunRet(result.returncode, result.stdout, result.stderr)
-    except subprocess.CalledProcessError as e:
-        return CmdRunRet(e.returncode, e.stdout, e.stderr)
+    finally:
+        if stdin_path:
+            stdin.close()
+
+
+class IRCache:
+    """Compiled IR keyed by a hash of the source and the compiler binary.
+
+    Tests sharing an example are compiled once per run, and unchanged examples
+    are not recompiled across runs as long as the compiler is not rebuilt."""
+
+    def __init__(self, compiler: str, cache_dir: str):
+        self.compiler = compiler
+        self.cache_dir = cache_dir
+        self.locks: Dict[str, threading.Lock] = {}
+        self.locks_guard = threading.Lock()
+
+        stat = os.stat(compiler)
+        self.compiler_id = f"{os.path.abspath(compiler)}:{stat.st_size}:{stat.st_mtime_ns}"
+        os.makedirs(cache_dir, exist_ok=True)
+
+    def _key(self, source_path: str, compiler_args: List[str]) -> str:
+        digest = hashlib.sha256(self.compiler_id.encode())
+        digest.update("\0".join(compiler_args).encode() + b"\0")
+        with open(source_path, 'rb') as f:
+            digest.update(f.read())
+        return digest.hexdigest()
+
+    def compile(self, source_path: str, compiler_args: List[str]) -> tuple[str, CmdRunRet]:
+        """Returns the path of the compiled module and the compiler's result."""
+        key = self._key(source_path, compiler_args)
+        ir_path = os.path.join(self.cache_dir, f"{key}.ll")
+        log_path = os.path.join(self.cache_dir, f"{key}.json")
+
+        with self.locks_guard:
+            lock = self.locks.setdefault(key, threading.Lock())
+
+        with lock:
+            if os.path.exists(ir_path) and os.path.exists(log_path):
+                with open(log_path, 'r', encoding="utf-8") as f:
+                    return ir_path, CmdRunRet(**json.load(f))
+
+            # Written to a temporary name first so a cancelled run never leaves a partial module
+            tmp_path = f"{ir_path}.{os.getpid()}.tmp"
+            result = run_command([self.compiler, *compiler_args, source_path, "-o", tmp_path])
+            if result.exit_code != 0:
+                if os.path.exists(tmp_path):
+                    os.remove(tmp_path)
+                return ir_path, result
+
+            os.replace(tmp_path, ir_path)
+            with open(log_path, 'w', encoding="utf-8") as f:
+                json.dump({"exit_code": result.exit_code, "stdout": result.stdout,
+                           "stderr": result.stderr}, f)
+            return ir_path, result
+
+
+def check_result(test: TestType, args: argparse.Namespace, result: CmdRunRet, cmd: List[str]):
+    """Raises if the exit code or output differ from the test's snapshots."""
+    snapshot_root = os.path.join(args.artifact_root, 'snapshots')
+
+    if result.exit_code != test['exit_code']:
+        raise AssertionError(
+            f"Exit code mismatch:\n"
+            f"  Expected: {test['exit_code']}\n"
+            f"  Got:      {result.exit_code}\n"
+            f"  Command:  {' '.join(cmd)}"
+        )
+
+    for stream_type in ['stdout', 'stderr']:
+        with open(os.path.join(snapshot_root, f"{test['file_name']}_{stream_type}.txt"), 'r',
+                  encoding="utf-8") as f:
+            expected = f.read()
+            actual = getattr(result, stream_type)
+            if expected != actual:
+                raise AssertionError(
+                    f"{stream_type} mismatch:\n"
+                    f"  Expected: '{expected}'\n"
+                    f"  Got:      '{actual}'"
+                )
+
+
+def run_test(test: TestType, args: argparse.Namespace, cache: IRCache | None,
+             ast_dir: str | None = None, objects_dir: str | None = None) -> TestResult:
+    """Runs one test, through a binary AST file written to ast_dir if given, or as an
+    executable linked from the native objects of a sharded build written to objects_dir."""
+    EXAMPLE_ROOT = os.path.join(args.artifact_root, 'examples')
+    SNAPSHOT_ROOT = os.path.join(args.artifact_root, 'snapshots')
+
+    paths = {
+        "example": os.path.join(EXAMPLE_ROOT, f"{test['file_name']}.lge"),
+        "stdin": os.path.join(SNAPSHOT_ROOT, f"{test['file_name']}_stdin.txt"),
+        "stdout": os.path.join(SNAPSHOT_ROOT, f"{test['file_name']}_stdout.txt"),
+        "stderr": os.path.join(SNAPSHOT_ROOT, f"{test['file_name']}_stderr.txt")
+    }
+    stdin_path = paths['stdin'] if test['has_stdin'] else None
+    compiler_args = test.get('compiler_args', [])
+
+    start = time.perf_counter()
+    try:
+        for path_type, path in paths.items():
+            if path_type == "stdin" and stdin_path is None:
+                continue
+            if not os.path.exists(path):
+                raise FileNotFoundError(
+                    f"Missing {path_type} file: {path}")
+
+        # Written by the front end and compiled instead of the source, the
+        # output must be the same
+        source_path = paths['example']
+        if ast_dir is not None:
+            fd, source_path = tempfile.mkstemp(suffix=".lgeast", dir=ast_dir)
+            os.close(fd)
+            emitted = run_command([args.compiler, "--emit=ast", "-o", source_path, paths['example']])
+            if emitted.exit_code != 0:
+                raise AssertionError(
+                    f"Writing the AST failed with exit code {emitted.exit_code}:\n"
+                    f"  {emitted.stderr}"
+                )
+
+        # Execute test
+        if objects_dir is not None:
+            # --emit=obj writes one object per shard, linked by the system linker
+            base = tempfile.mkdtemp(dir=objects_dir)
+            compiled = run_command([args.compiler, *compiler_args, "--emit=obj", "-o",
+                                    os.path.join(base, "app.o"), source_path])
+            if compiled.exit_code != 0:
+                raise AssertionError(
+                    f"Compilation failed with exit code {compiled.exit_code}:\n"
+                    f"  {compiled.stderr}"
+                )
+
+            objects = sorted(os.path.join(base, name) for name in os.listdir(base))
+            executable = os.path.join(base, "app")
+            run_time = os.path.abspath(args.run_time)
+            linked = run_command([args.cc, *objects, run_time,
+                                  f"-Wl,-rpath,{os.path.dirname(run_time)}", "-o", executable])
+            if linked.exit_code != 0:
+                raise AssertionError(
+                    f"Linking failed with exit code {linked.exit_code}:\n"
+                    f"  {linked.stderr}"
+                )
+
+            cmd = [executable]
+            result = run_command(cmd, stdin_path)
+            result.stderr = compiled.stderr + result.stderr
+        elif cache is None or test.get('repl', False):
+            mode = "--repl" if test.get('repl', False) else "--run"
+            cmd = [args.compiler, *compiler_args, mode, "--load", args.run_time, source_path]
+            result = run_command(cmd, stdin_path)
+        else:
+            ir_path, compiled = cache.compile(source_path, compiler_args)
+            if compiled.exit_code != 0:
+                raise AssertionError(
+                    f"Compilation failed with exit code {compiled.exit_code}:\n"
+                    f"  {compiled.stderr}"
+                )
+
+            cmd = [args.lli, f"-load={args.run_time}", ir_path]
+            result = run_command(cmd, stdin_path)
+            # Diagnostics of the compiler are part of the expected stderr
+            result.stderr = compiled.stderr + result.stderr
+
+        check_result(test, args, result, cmd)
+        return TestResult(test, time.perf_counter() - start, None)
+
+    except Exception as e:
+        return TestResult(test, time.perf_counter() - start, str(e))
+
+
+def count_functions(args: argparse.Namespace, test: TestType) -> int:
+    """Number of top level definitions in the test's example."""
+    with open(os.path.join(args.artifact_root, 'examples', f"{test['file_name']}.lge"), 'r',
+              encoding="utf-8") as f:
+        return len(re.findall(r"^let ", f.read(), re.MULTILINE))
+
+
+def supports_link_runtime(args: argparse.Namespace) -> bool:
+    """Whether the compiler was built with the runtime bitcode --link-runtime links in."""
+    source_path = os.path.join(args.artifact_root, 'examples', "hello_world.lge")
+    result = run_command([args.compiler, "--link-runtime", source_path, "-o", os.devnull])
+    return "without runtime bitcode" not in result.stderr
+
+
+def run_corrupt_ast_tests(args: argparse.Namespace, ast_dir: str) -> List[TestResult]:
+    """Damaged AST files must be rejected with an error, not crash the compiler."""
+    source_path = os.path.join(args.artifact_root, 'examples', "hello_world.lge")
+    valid_path = os.path.join(ast_dir, "valid.lgeast")
+    emitted = run_command([args.compiler, "--emit=ast", "-o", valid_path, source_path])
+
+    valid = b""
+    if emitted.exit_code == 0:
+        with open(valid_path, 'rb') as f:
+            valid = f.read()
+    version = int.from_bytes(valid[8:12], "little")
+
+    # Name => (contents, expected part of the error)
+    cases = {
+        "Truncated AST file": (valid[:len(valid) // 2], "Invalid AST file"),
+        "AST file of another version": (valid[:8] + (version + 1).to_bytes(4, "little") + valid[12:],
+                                        "unsupported format version"),
+        "Corrupt AST file": (valid[:12] + b"\xff" * (len(valid) - 12), "Invalid AST file"),
+    }
+
+    results: List[TestResult] = []
+    for index, (name, (contents, expected_error)) in enumerate(cases.items()):
+        test: TestType = {"name": name, "file_name": "hello_world", "exit_code": 1,
+                          "has_stdin": False}
+        start = time.perf_counter()
+        error = None
+        if emitted.exit_code != 0:
+            error = f"Writing the AST failed with exit code {emitted.exit_code}:\n  {emitted.stderr}"
+        else:
+            path = os.path.join(ast_dir, f"corrupt_{index}.lgeast")
+            with open(path, 'wb') as f:
+                f.write(contents)
+            result = run_command([args.compiler, path, "-o", os.devnull])
+            if result.exit_code != 1 or expected_error not in result.stderr:
+                error = (f"Expected exit code 1 and '{expected_error}' on stderr\n"
+                         f"  Got:      {result.exit_code}\n"
+                         f"  Stderr:   '{result.stderr}'")
+        results.append(TestResult(test, time.perf_counter() - start, error))
+    return results
+
+
+def run_function_cache_tests(args: argparse.Namespace) -> List[TestResult]:
+    """Recompiling with --cache-dir must reuse unchanged functions and give the same module,
+    while a function whose callee changed its signature or purity is compiled again."""
+    work_dir = tempfile.mkdtemp(prefix="lge_test_function_cache_")
+    cache_dir = os.path.join(work_dir, "cache")
+    main = "let other: int = () -> 1\n\nlet main: int = () -> twice(21) + other()\n"
+    sources = {
+        "original": "let twice: int = (n: int) -> n * 2\n\n" + main,
+        "signature": "let twice: int = (n: i16) -> n * 2\n\n" + main,
+        "purity": "let twice: int = (n: int) -> n * 2 + str_print(\"\")\n\n" + main,
+        # Both definitions of other() are in the cache already
+        "duplicate": "let twice: int = (n: int) -> n * 2\n\n" + main + "\nlet other: int = () -> 1\n",
+    }
+
+    def compile_source(version: str) -> tuple[CmdRunRet, str, tuple[int, int]]:
+        """Returns the result, the emitted IR and the cache's (hits, misses)."""
+        source_path = os.path.join(work_dir, f"{version}.lge")
+        ir_path = os.path.join(work_dir, f"{version}.ll")
+        with open(source_path, 'w', encoding="utf-8") as f:
+            f.write(sources[version])
+        result = run_command([args.compiler, "--cache-dir", cache_dir, "--time-report",
+                              source_path, "-o", ir_path])
+        counts = re.search(r"Function cache: (\d+) hits, (\d+) misses", result.stderr)
+        ir = ""
+        if os.path.exists(ir_path):
+            with open(ir_path, 'r', encoding="utf-8") as f:
+                ir = f.read()
+        return result, ir, (int(counts[1]), int(counts[2])) if counts else (0, 0)
+
+    def expect_counts(version: str, expected: tuple[int, int]) -> str:
+        result, ir, counts = compile_source(version)
+        if result.exit_code != 0:
+            raise AssertionError(f"Compilation failed with exit code {result.exit_code}:\n"
+                                 f"  {result.stderr}")
+        if counts != expected:
+            raise AssertionError(f"Expected {expected[0]} hits and {expected[1]} misses\n"
+                                 f"  Got:      {counts[0]} hits and {counts[1]} misses")
+        return ir
+
+    def reused():
+        first = expect_counts("original", (0, 3))
+        second = expect_counts("original", (3, 0))
+        if first != second:
+            raise AssertionError(f"Module differs when loaded from the cache:\n"
+                                 f"  Compiled: '{first}'\n"
+                                 f"  Cached:   '{second}'")
+
+    def duplicate():
+        result, _, _ = compile_source("duplicate")
+        expected_error = "Duplicate definition of function: other"
+        if result.exit_code != 1 or expected_error not in result.stderr:
+            raise AssertionError(f"Expected exit code 1 and '{expected_error}' on stderr\n"
+                                 f"  Got:      {result.exit_code}\n"
+                                 f"  Stderr:   '{result.stderr}'")
+
+    # Run in order, each case starts from the cache the previous ones left.
+    # Only twice() and its caller main() are compiled again after an edit.
+    cases = {
+        "Function cache: unchanged functions reused": reused,
+        "Function cache: caller rebuilt after a callee signature change":
+            lambda: expect_counts("signature", (1, 2)),
+        "Function cache: caller rebuilt after a callee purity change":
+            lambda: expect_counts("purity", (1, 2)),
+        "Function cache: duplicate of a cached function reported": duplicate,
+    }
+
+    results: List[TestResult] = []
+    for name, case in cases.items():
+        test: TestType = {"name": name, "file_name": "", "exit_code": 0, "has_stdin": False}
+        start = time.perf_counter()
+        error = None
+        try:
+            case()
+        except Exception as e:
+            error = str(e)
+        results.append(TestResult(test, time.perf_counter() - start, error))
+
+    shutil.rmtree(work_dir, ignore_errors=True)
+    return results
+
+
+def run_server_tests(args: argparse.Namespace) -> List[TestResult]:
+    """Examples run through --connect on a compile server must behave as a direct run, and
+    the server must keep serving after each of them."""
+    tests: List[TestType] = [
+        {"name": "Compile server: Hello world", "file_name": "hello_world", "exit_code": 0,
+         "has_stdin": False},
+        {"name": "Compile server: Exit 100", "file_name": "exit_-100", "exit_code": 156,
+         "has_stdin": False},
+    ]
+
+    socket_dir = tempfile.mkdtemp(prefix="lge_test_server_")
+    socket_path = os.path.join(socket_dir, "lgec.sock")
+    server = subprocess.Popen([args.compiler, "--serve", socket_path], stdin=subprocess.DEVNULL,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+
+    results: List[TestResult] = []
+    try:
+        deadline = time.monotonic() + 10
+        while not os.path.exists(socket_path) and server.poll() is None and time.monotonic() < deadline:
+            time.sleep(0.01)
+
+        for test in tests:
+            start = time.perf_counter()
+            error = None
+            try:
+                source_path = os.path.join(args.artifact_root, 'examples', f"{test['file_name']}.lge")
+                cmd = [args.compiler, "--connect", socket_path, "--run", "--load",
+                       os.path.abspath(args.run_time), source_path]
+                check_result(test, args, run_command(cmd), cmd)
+                if server.poll() is not None:
+                    raise AssertionError(f"Server exited with code {server.returncode}:\n"
+                                         f"  {server.stderr.read()}")
+            except Exception as e:
+                error = str(e)
+            results.append(TestResult(test, time.perf_counter() - start, error))
+    finally:
+        server.kill()
+        server.wait()
+        shutil.rmtree(socket_dir, ignore_errors=True)
+    return results
 
 
 def main(args: argparse.Namespace):
@@ -49,14 +413,11 @@ def main(args: argparse.Namespace):
     ARTIFACT_ROOT: str = args.artifact_root
     RUN_TIME: str = args.run_time
 
-    EXAMPLE_ROOT = os.path.join(ARTIFACT_ROOT, 'examples')
-    SNAPSHOT_ROOT = os.path.join(ARTIFACT_ROOT, 'snapshots')
-
     print(f"Using compiler:       {COMPILER_EXE}\n"
           f"Using suite file:     {SUITE_FILE}\n"
           f"Using artifact root:  {ARTIFACT_ROOT}\n"
-          f"Example root:         {EXAMPLE_ROOT}\n"
-          f"Snapshot root:        {SNAPSHOT_ROOT}")
+          f"Execution mode:       {'jit' if args.jit else 'lli'}\n"
+          f"Workers:              {args.jobs}")
 
     suite: JsonType | None = None
     with open(SUITE_FILE, 'r', encoding="utf-8") as f:
@@ -69,99 +430,90 @@ def main(args: argparse.Namespace):
     print(f"\n📋 Test Suite v{suite['version']}")
     print("=" * 60)
 
-    stats = {
-        "total": len(suite['tests']),
-        "passed": 0,
-        "failed": [],
-        "start_time": time.time()
-    }
-
-    for idx, test in enumerate(suite['tests'], 1):
-        print(f"\n[{idx}/{stats['total']}] 🔍 Test: {test['name']}")
-        paths = {
-            "example": os.path.join(EXAMPLE_ROOT, f"{test['file_name']}.lge"),
-            "stdin": os.path.join(SNAPSHOT_ROOT, f"{test['file_name']}_stdin.txt"),
-            "stdout": os.path.join(SNAPSHOT_ROOT, f"{test['file_name']}_stdout.txt"),
-            "stderr": os.path.join(SNAPSHOT_ROOT, f"{test['file_name']}_stderr.txt")
-        }
-        print(f"\tExample:         {paths['example']}")
-        if test['has_stdin'] == True:
-            print(f"\tExpected stdin:  {paths['stdin']}")
-        print(f"\tExpected stdout: {paths['stdout']}")
-        print(f"\tExpected stderr: {paths['stderr']}")
-        print("-" * 40)
-
-        try:
-            for path_type, path in paths.items():
-                if not os.path.exists(path) and not path.find("stdin"):
-                    raise FileNotFoundError(
-                        f"Missing {path_type} file: {path}")
-
-            # Execute test
-            if test['has_stdin'] == True:
-                tmp_file = f"/tmp/tmp_{test['file_name']}.ll"
-                comp_cmd = f"{COMPILER_EXE} {paths['example']} > {tmp_file}"
-
-                print(f"⚙️  Running: '{comp_cmd}'")
-                result = run_command(comp_cmd)
-                if result.exit_code != 0:
-                    raise AssertionError(
-                        f"Exit code mismatch:\n"
-                        f"  Expected: 0\n"
-                        f"  Got:      {result.exit_code}"
-                    )
-
-                cmd = f"lli -load={RUN_TIME} {tmp_file} < {paths['stdin']}"
-            else:
-                cmd = f"{COMPILER_EXE} {paths['example']} | lli -load={RUN_TIME}"
-
-            print(f"⚙️  Running: '{cmd}'")
-            result = run_command(cmd)
-
-            # Validate results
-            if result.exit_code != test['exit_code']:
-                raise AssertionError(
-                    f"Exit code mismatch:\n"
-                    f"  Expected: {test['exit_code']}\n"
-                    f"  Got:      {result.exit_code}"
-                )
-
-            for stream_type in ['stdout', 'stderr']:
-                with open(paths[stream_type], 'r', encoding="utf-8") as f:
-                    expected = f.read()
-                    actual = getattr(result, stream_type)
-                    if expected != actual:
-                        raise AssertionError(
-                            f"{stream_type} mismatch:\n"
-                            f"  Expected: '{expected}'\n"
-                            f"  Got:      '{actual}'"
-                        )
-
-            print("✅ PASSED")
-            stats['passed'] += 1
-
-        except Exception as e:
-            print(f"❌ FAILED: {str(e)}")
-            stats['failed'].append((test['name'], str(e)))
+    # --link-runtime needs the runtime bitcode, embedded only if clang was found at build time
+    tests = suite['tests']
+    skipped = []
+    if not supports_link_runtime(args):
+        skipped = [test for test in tests if "--link-runtime" in test.get('compiler_args', [])]
+        tests = [test for test in tests if test not in skipped]
+        for test in skipped:
+            print(f"⚠️  Skipping {test['name']}: lgec was built without runtime bitcode")
+
+    cache = None if args.jit else IRCache(COMPILER_EXE, args.cache_dir)
+    ast_dir = None if args.no_ast else tempfile.mkdtemp(prefix="lge_test_ast_")
+    objects_dir = None if args.no_shards else tempfile.mkdtemp(prefix="lge_test_objects_")
+    # Examples with several functions, split over shards
+    sharded = [] if objects_dir is None else [test for test in tests
+                                              if not test.get('repl', False) and
+                                              count_functions(args, test) > 1]
+    # The runtime can't be linked into separate objects
+    sharded_objects = [test for test in sharded
+                       if "--link-runtime" not in test.get('compiler_args', [])]
+    start_time = time.time()
+    corrupt = [] if ast_dir is None else run_corrupt_ast_tests(args, ast_dir)
+    server = run_server_tests(args)
+    function_cache = run_function_cache_tests(args)
+    total = (len(tests) * (1 if ast_dir is None else 2) + len(sharded) + len(sharded_objects) +
+             len(corrupt) + len(server) + len(function_cache))
+    results: List[TestResult] = []
+
+    def report(result: TestResult):
+        results.append(result)
+        status = "✅" if result.error is None else "❌"
+        print(f"[{len(results)}/{total}] {status} {result.test['name']} ({result.duration * 1000:.1f} ms)")
+
+    for result in corrupt + server + function_cache:
+        report(result)
+
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        futures = [pool.submit(run_test, test, args, cache) for test in tests]
+        if ast_dir is not None:
+            # Every example again, through --emit=ast and the .lgeast file
+            futures += [pool.submit(run_test, {**test, "name": f"{test['name']} (AST round trip)"},
+                                    args, cache, ast_dir) for test in tests]
+        # Shards linked into one module, and one native object per shard
+        for test in sharded:
+            shard_args = [*test.get('compiler_args', []), f"--shards={SHARDS}"]
+            futures.append(pool.submit(run_test, {**test, "name": f"{test['name']} ({SHARDS} shards)",
+                                                  "compiler_args": shard_args}, args, cache))
+        for test in sharded_objects:
+            shard_args = [*test.get('compiler_args', []), f"--shards={SHARDS}"]
+            futures.append(pool.submit(run_test, {**test,
+                                                  "name": f"{test['name']} ({SHARDS} shard objects)",
+                                                  "compiler_args": shard_args},
+                                       args, cache, None, objects_dir))
+        for future in as_completed(futures):
+            report(future.result())
+
+    for directory in [ast_dir, objects_dir]:
+        if directory is not None:
+            shutil.rmtree(directory, ignore_errors=True)
 
     # Print summary
-    duration = time.time() - stats['start_time']
+    failed = [r for r in results if r.error is not None]
+    duration = time.time() - start_time
     print("\n" + "=" * 60)
     print("📊 Test Summary")
     print("-" * 60)
-    print(f"Total Tests:    {stats['total']}")
-    print(f"Passed:         {stats['passed']}")
-    print(f"Failed:         {len(stats['failed'])}")
+    print(f"Total Tests:    {total}")
+    print(f"Passed:         {total - len(failed)}")
+    print(f"Failed:         {len(failed)}")
+    print(f"Skipped:        {len(skipped)}")
     print(f"Duration:       {duration:.2f}s")
 
-    if stats['failed']:
+    print("\n🐢 Slowest Tests:")
+    for result in sorted(results, key=lambda r: r.duration, reverse=True)[:args.slowest]:
+        print(f"  {result.duration * 1000:8.1f} ms  {result.test['name']}")
+
+    if failed:
         print("\n❌ Failed Tests:")
-        for name, error in stats['failed']:
-            print(f"  • {name}")
-            print(f"    {error}")
+        for result in failed:
+            print(f"  • {result.test['name']}")
+            print(f"    {result.error}")
 
-    success = len(stats['failed']) == 0
+    success = len(failed) == 0
     print(f"\n{'🎉 All tests passed!' if success else '💔 Some tests failed.'}")
+    sys.exit(0 if success else 1)
 
 
 if __name__ == '__main__':
@@ -176,6 +528,21 @@ if __name__ == '__main__':
                         help="Suite file which contains the test definitions", required=True)
     parser.add_argument("-a", "--artifact-root", default=os.path.dirname(os.path.abspath(__file__)),
                         help="Parent folder of examples and snapshots")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1,
+                        help="Number of tests run in parallel (default: number of cores)")
+    parser.add_argument("--jit", action="store_true",
+                        help="Compile and run each test in-process with 'lgec --run' instead of lli")
+    parser.add_argument("--cache-dir", default=os.path.join(tempfile.gettempdir(), "lge_test_cache"),
+                        help="Folder for compiled IR, keyed by source and compiler hash")
+    parser.add_argument("--no-ast", action="store_true",
+                        help="Skip running the examples again through binary AST files (--emit=ast)")
+    parser.add_argument("--no-shards", action="store_true",
+                        help=f"Skip running multi-function examples again with --shards={SHARDS}")
+    parser.add_argument("--lli", default="lli", help="lli executable")
+    parser.add_argument("--cc", default="cc",
+                        help="C compiler linking the objects of sharded builds (--emit=obj)")
+    parser.add_argument("--slowest", type=int, default=5,
+                        help="Number of slowest tests to list in the summary")
 
     args = parser.parse_args()
 